@@ -0,0 +1,212 @@
+// Arduino Timezone Library Copyright (C) 2018 by Jack Christensen and
+// licensed under GNU GPL v3.0, https://www.gnu.org/licenses/gpl.html
+//
+// Arduino Timezone Library example sketch.
+// Benchmark: times the single-value and batch UTC to local conversions
+// and the DST test for northern, southern and no-DST time zones, with
+// sorted, random, single-year and time change-dense input times, and
+// prints a table of conversions per second and the 99th percentile
+// time per conversion (for the batch functions, the batch's time shared
+// among its conversions), to help choose between the functions for a
+// workload.
+// The single-value toLocal() is also timed with a table of time changes
+// (setTable()) and, with TZ_ADAPTIVE, with each engine pinned by
+// setEngine(). Also compares breaking local times into calendar fields with
+// toLocal() and breakTime() against breakLocal(), and building a table
+// of time changes (setTable()) as conversions need it against
+// fillTable().
+
+#include <Timezone.h>   // https://github.com/JChristensen/Timezone
+#include <TimeLib.h>    // https://github.com/PaulStoffregen/Time
+
+// US Eastern Time Zone (New York, Detroit)
+TimeChangeRule usEDT = {"EDT", Second, Sun, Mar, 2, -240};
+TimeChangeRule usEST = {"EST", First, Sun, Nov, 2, -300};
+Timezone usET(usEDT, usEST);
+
+// New Zealand Time Zone
+TimeChangeRule nzSTD = {"NZST", First, Sun, Apr, 3, 720};   // UTC + 12 hours
+TimeChangeRule nzDST = {"NZDT", Last, Sun, Sep, 2, 780};    // UTC + 13 hours
+Timezone nz(nzDST, nzSTD);
+
+// US Arizona, no daylight time
+TimeChangeRule usMST = {"MST", First, Sun, Nov, 2, -420};
+Timezone usAZ(usMST);
+
+Timezone *zones[] = {&usET, &nz, &usAZ};
+const char *zoneNames[] = {"north", "south", "noDST"};
+const uint8_t nZones(sizeof(zones) / sizeof(zones[0]));
+
+enum dist_t {Sorted, Random, OneYear, Changes};
+const char *distNames[] = {"sorted", "random", "1 year", "changes"};
+const uint8_t nDists(4);
+
+// engines: single-value toLocal(), batch toLocal() in batches of
+// BATCH_SMALL and N, single-value utcIsDST(), the local calendar
+// fields by toLocal() and breakTime() or by breakLocal() in batches of
+// BATCH_SMALL, and single-value toLocal() with a table of time changes
+// and with each engine of setEngine()
+#if TZ_ADAPTIVE
+const char *engineNames[] = {"toLocal", "batch 8", "batch 64", "isDST", "breakTm", "fields 8",
+    "table", "yrCache", "cursor"};
+const uint8_t nEngines(9);
+#else
+const char *engineNames[] = {"toLocal", "batch 8", "batch 64", "isDST", "breakTm", "fields 8",
+    "table"};
+const uint8_t nEngines(7);
+#endif
+const uint8_t BATCH_SMALL(8);
+int fYear[BATCH_SMALL];
+uint8_t fMonth[BATCH_SMALL], fDay[BATCH_SMALL], fHour[BATCH_SMALL], fMinute[BATCH_SMALL], fSecond[BATCH_SMALL];
+LocalFields fields = {fYear, fMonth, fDay, fHour, fMinute, fSecond, NULL};
+
+const uint8_t N(64);            // times per run
+const uint8_t RUNS(16);         // runs per table row
+const uint8_t BUCKETS(64);      // latency histogram, 4us per bucket
+time_t in[N], out[N];
+uint16_t hist[BUCKETS];
+const uint8_t TABLE_YEARS(20);
+TimezoneTable table[TABLE_YEARS];
+
+void setup()
+{
+    Serial.begin(115200);
+    Serial.print(F("RAM per zone: "));
+    Serial.print(sizeof(Timezone));
+    Serial.println(F(" bytes"));
+    Serial.println(F("zone   input    engine     conv/s  p99 us/conv"));
+
+    for (uint8_t z=0; z<nZones; z++)
+    {
+        for (uint8_t d=0; d<nDists; d++)
+        {
+            for (uint8_t e=0; e<nEngines; e++)
+            {
+                uint32_t total = run(zones[z], d, e);
+                unsigned long perSec = total ? (float)N * RUNS * 1000000.0 / total : 0;
+                char buf[60];
+                sprintf(buf, "%-6s %-8s %-9s %7lu %12u", zoneNames[z], distNames[d], engineNames[e],
+                    perSec, p99());
+                Serial.println(buf);
+            }
+        }
+    }
+
+    // build a table of time changes for TABLE_YEARS years, first one year
+    // at a time by conversions, then all at once by fillTable()
+    for (uint8_t z=0; z<nZones; z++)
+    {
+        for (uint8_t y=0; y<TABLE_YEARS; y++) in[y] = makeUTC(2020 + y, 7);
+        zones[z]->setTable(table, 2020, TABLE_YEARS);
+        uint32_t us = micros();
+        for (uint8_t y=0; y<TABLE_YEARS; y++) zones[z]->toLocal(in[y]);
+        uint32_t lazy = micros() - us;
+
+        zones[z]->setTable(table, 2020, TABLE_YEARS);
+        us = micros();
+        zones[z]->fillTable();
+        uint32_t filled = micros() - us;
+        zones[z]->setTable(NULL, 0, 0);
+
+        Serial.print(zoneNames[z]);
+        Serial.print(F(" table "));
+        Serial.print(TABLE_YEARS);
+        Serial.print(F(" years: "));
+        Serial.print(lazy);
+        Serial.print(F(" us by conversions, "));
+        Serial.print(filled);
+        Serial.println(F(" us by fillTable()"));
+    }
+}
+
+void loop() {}
+
+// time RUNS runs of N conversions, return the total microseconds and
+// leave the time per conversion in hist, each batch counted once for
+// each of its conversions at the batch's time divided by its size
+uint32_t run(Timezone *tz, uint8_t dist, uint8_t engine)
+{
+    uint8_t batch = engine == 1 || engine == 5 ? BATCH_SMALL : engine == 2 ? N : 1;
+    uint32_t total(0);
+    memset(hist, 0, sizeof(hist));
+    if (engine == 6) tz->setTable(table, 2020, TABLE_YEARS);
+#if TZ_ADAPTIVE
+    if (engine == 7) tz->setEngine(TzYearCache);
+    if (engine == 8) tz->setEngine(TzCursor);
+#endif
+    for (uint8_t r=0; r<RUNS; r++)
+    {
+        fill(tz, dist);
+        for (uint8_t i=0; i<N; i+=batch)
+        {
+            uint32_t us = micros();
+            if (engine == 0 || engine >= 6)
+                out[i] = tz->toLocal(in[i]);
+            else if (engine == 3)
+                out[i] = tz->utcIsDST(in[i]);
+            else if (engine == 4)
+            {
+                tmElements_t tm;
+                breakTime(tz->toLocal(in[i]), tm);
+                out[i] = tm.Hour;
+            }
+            else if (engine == 5)
+                tz->breakLocal(in + i, fields, batch);
+            else
+                tz->toLocal(in + i, out + i, batch);
+            us = micros() - us;
+            total += us;
+            us /= batch;
+            hist[us / 4 < BUCKETS ? us / 4 : BUCKETS - 1] += batch;
+        }
+    }
+    tz->setTable(NULL, 0, 0);
+#if TZ_ADAPTIVE
+    tz->setEngine(TzAuto);
+#endif
+    return total;
+}
+
+// fill the input times with the given distribution
+void fill(Timezone *tz, uint8_t dist)
+{
+    time_t base = makeUTC(2020 + random(10), 1 + random(12));
+    time_t change = tz->nextTimeChange(base);
+    if (change == 0) change = base;
+    for (uint8_t i=0; i<N; i++)
+    {
+        switch (dist)
+        {
+            case Sorted:  in[i] = base + i * 37L; break;
+            case Random:  in[i] = makeUTC(1980 + random(50), 1) + random(SECS_PER_YEAR); break;
+            case OneYear: in[i] = makeUTC(2025, 1) + random(SECS_PER_YEAR); break;
+            case Changes: in[i] = change + random(-7200, 7200); break;
+        }
+    }
+}
+
+// 99th percentile time per conversion from the histogram, in microseconds
+unsigned p99()
+{
+    uint32_t n(0), seen(0);
+    for (uint8_t b=0; b<BUCKETS; b++) n += hist[b];
+    for (uint8_t b=0; b<BUCKETS; b++)
+    {
+        seen += hist[b];
+        if (seen * 100 >= n * 99) return (b + 1) * 4;
+    }
+    return BUCKETS * 4;
+}
+
+// UTC at the start of the given month
+time_t makeUTC(int y, uint8_t m)
+{
+    tmElements_t tm;
+    tm.Second = 0;
+    tm.Minute = 0;
+    tm.Hour = 0;
+    tm.Day = 1;
+    tm.Month = m;
+    tm.Year = y - 1970;
+    return makeTime(tm);
+}
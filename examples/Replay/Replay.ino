@@ -0,0 +1,158 @@
+// Arduino Timezone Library Copyright (C) 2018 by Jack Christensen and
+// licensed under GNU GPL v3.0, https://www.gnu.org/licenses/gpl.html
+//
+// Arduino Timezone Library example sketch.
+// Captures the inputs of a workload's conversions into a compact
+// TimezoneTrace, then replays the trace through the single-value
+// conversion functions, with and without a table of time changes and,
+// with TZ_ADAPTIVE, with each engine pinned by setEngine(), and through
+// the batch conversion functions, printing the time taken and the
+// number of time change calculations for each. Replace runWorkload()
+// with the conversions made by your own sketch.
+//
+// Requires TZ_INSTRUMENT to be set to 1 in Timezone.h.
+
+#include <Timezone.h>       // https://github.com/JChristensen/Timezone
+#include <TimezoneTrace.h>
+#include <TimeLib.h>        // https://github.com/PaulStoffregen/Time
+
+#if !TZ_INSTRUMENT
+#error "Set TZ_INSTRUMENT to 1 in Timezone.h to run this sketch."
+#endif
+
+// US Eastern Time Zone (New York, Detroit)
+TimeChangeRule usEDT = {"EDT", Second, Sun, Mar, 2, -240};
+TimeChangeRule usEST = {"EST", First, Sun, Nov, 2, -300};
+Timezone usET(usEDT, usEST);
+
+uint8_t traceBuf[512];
+TimezoneTrace trace(traceBuf, sizeof(traceBuf));
+
+const uint8_t TABLE_YEARS(12);  // 2008 to 2019, the workload's years
+TimezoneTable table[TABLE_YEARS];
+
+void setup()
+{
+    Serial.begin(115200);
+
+    // capture
+    Timezone::setCapture(capture);
+    runWorkload();
+    Timezone::setCapture(NULL);
+    Serial.print(trace.records());
+    Serial.print(F(" conversions captured in "));
+    Serial.print(trace.length());
+    Serial.println(F(" bytes"));
+
+    // replay through the single-value functions, then with a table of
+    // time changes, then with each engine
+    replaySingle(F("single "));
+    usET.setTable(table, 2008, TABLE_YEARS);
+    replaySingle(F("table  "));
+    usET.setTable(NULL, 0, 0);
+#if TZ_ADAPTIVE
+    usET.setEngine(TzYearCache);
+    replaySingle(F("yrCache"));
+    usET.setEngine(TzCursor);
+    replaySingle(F("cursor "));
+    usET.setEngine(TzAuto);
+#endif
+
+    // replay through the batch functions, 16 times at a time
+    const uint8_t BATCH(16);
+    time_t buf[BATCH];
+    bool dst[BATCH];
+    uint8_t mask[(BATCH + 7) / 8];
+    usET.resetStats();
+    trace.rewind();
+    uint8_t op;
+    time_t t;
+    uint32_t us = micros();
+    uint8_t n(0), batchOp(0);
+    for (;;)
+    {
+        bool more = trace.read(&op, &t);
+        if (n > 0 && (!more || n == BATCH || op != batchOp))
+        {
+            switch (batchOp)
+            {
+                case TzToLocal:  usET.toLocal(buf, buf, n);     break;
+                case TzToUTC:    usET.toUTC(buf, buf, n);       break;
+                case TzUtcIsDST: usET.utcIsDST(buf, dst, n);    break;
+                case TzLocIsDST: usET.locDSTMask(buf, mask, n); break;
+            }
+            n = 0;
+        }
+        if (!more) break;
+        batchOp = op;
+        buf[n++] = t;
+    }
+    printResult(F("batch  "), micros() - us);
+}
+
+void loop() {}
+
+// replay the trace through the single-value functions
+void replaySingle(const __FlashStringHelper *name)
+{
+    usET.resetStats();
+    trace.rewind();
+    uint8_t op;
+    time_t t;
+    uint32_t us = micros();
+    while (trace.read(&op, &t))
+    {
+        switch (op)
+        {
+            case TzToLocal:  usET.toLocal(t);  break;
+            case TzToUTC:    usET.toUTC(t);    break;
+            case TzUtcIsDST: usET.utcIsDST(t); break;
+            case TzLocIsDST: usET.locIsDST(t); break;
+        }
+    }
+    printResult(name, micros() - us);
+}
+
+// record each conversion in the trace
+void capture(Timezone *tz, uint8_t op, time_t t)
+{
+    if (tz == &usET) trace.write(op, t);
+}
+
+// a workload of mostly sorted times, a backfill of older times,
+// and times clustered around a time change
+void runWorkload()
+{
+    time_t t = makeUTC(2018, 6, 1);
+    for (int i=0; i<100; i++) usET.toLocal(t += 37);
+
+    time_t old = makeUTC(2009, 1, 1);
+    for (int i=0; i<20; i++) usET.toLocal(old += 11 * SECS_PER_DAY);
+
+    time_t change = usET.nextTimeChange(t);
+    for (int i=-30; i<30; i++) usET.utcIsDST(change + i * 60);
+}
+
+time_t makeUTC(int y, uint8_t m, uint8_t d)
+{
+    tmElements_t tm;
+    tm.Second = 0;
+    tm.Minute = 0;
+    tm.Hour = 0;
+    tm.Day = d;
+    tm.Month = m;
+    tm.Year = y - 1970;
+    return makeTime(tm);
+}
+
+void printResult(const __FlashStringHelper *name, uint32_t us)
+{
+    Serial.print(name);
+    Serial.print(F(": "));
+    Serial.print(us);
+    Serial.print(F(" us, "));
+    Serial.print(usET.stats().conversions);
+    Serial.print(F(" conversions, "));
+    Serial.print(usET.stats().calcs);
+    Serial.println(F(" calcs"));
+}
@@ -0,0 +1,113 @@
+// Arduino Timezone Library Copyright (C) 2018 by Jack Christensen and
+// licensed under GNU GPL v3.0, https://www.gnu.org/licenses/gpl.html
+//
+// Arduino Timezone Library example sketch.
+// Soak test: runs the conversions done by the Clock and WorldClock
+// sketches against a virtual clock that advances much faster than real
+// time, so that decades of year rollovers and time changes can be
+// observed in minutes. For each simulated year, prints the number of
+// conversions, time change calculations and family cache hits, and the
+// average conversion time.
+//
+// Requires TZ_INSTRUMENT to be set to 1 in Timezone.h.
+
+#include <Timezone.h>   // https://github.com/JChristensen/Timezone
+#include <TimeLib.h>    // https://github.com/PaulStoffregen/Time
+
+#if !TZ_INSTRUMENT
+#error "Set TZ_INSTRUMENT to 1 in Timezone.h to run this sketch."
+#endif
+
+const int START_YEAR(2020);     // first simulated year
+const int END_YEAR(2050);       // simulation stops at the start of this year
+const long STEP(600);           // simulated seconds per loop() iteration
+
+// New Zealand Time Zone
+TimeChangeRule nzSTD = {"NZST", First, Sun, Apr, 3, 720};   // UTC + 12 hours
+TimeChangeRule nzDST = {"NZDT", Last, Sun, Sep, 2, 780};    // UTC + 13 hours
+Timezone nz(nzDST, nzSTD);
+
+// Central European Time (Frankfurt, Paris)
+TimeChangeRule CEST = {"CEST", Last, Sun, Mar, 2, 120};     // Central European Summer Time
+TimeChangeRule CET = {"CET ", Last, Sun, Oct, 3, 60};       // Central European Standard Time
+Timezone CE(CEST, CET);
+
+// US Eastern, Central, Mountain and Pacific Time Zones
+TimeChangeRule usEDT = {"EDT", Second, Sun, Mar, 2, -240};
+TimeChangeRule usEST = {"EST", First, Sun, Nov, 2, -300};
+Timezone usET(usEDT, usEST);
+TimeChangeRule usCDT = {"CDT", Second, Sun, Mar, 2, -300};
+TimeChangeRule usCST = {"CST", First, Sun, Nov, 2, -360};
+Timezone usCT(usCDT, usCST);
+TimeChangeRule usMDT = {"MDT", Second, Sun, Mar, 2, -360};
+TimeChangeRule usMST = {"MST", First, Sun, Nov, 2, -420};
+Timezone usMT(usMDT, usMST);
+Timezone usAZ(usMST);
+TimeChangeRule usPDT = {"PDT", Second, Sun, Mar, 2, -420};
+TimeChangeRule usPST = {"PST", First, Sun, Nov, 2, -480};
+Timezone usPT(usPDT, usPST);
+
+Timezone *zones[] = {&nz, &CE, &usET, &usCT, &usMT, &usAZ, &usPT};
+const uint8_t nZones(sizeof(zones) / sizeof(zones[0]));
+
+int simYear;                    // year being simulated
+uint32_t convMicros;            // time spent converting in the current year
+
+void setup()
+{
+    Serial.begin(115200);
+    Serial.println(F("Year  Conversions  Calcs  FamilyHits  us/Conv"));
+
+    tmElements_t tm;
+    tm.Second = 0;
+    tm.Minute = 0;
+    tm.Hour = 0;
+    tm.Day = 1;
+    tm.Month = 1;
+    tm.Year = START_YEAR - 1970;
+    setTime(makeTime(tm));      // the virtual clock, in UTC
+    simYear = START_YEAR;
+}
+
+void loop()
+{
+    if (simYear >= END_YEAR) return;
+
+    time_t utc = now();
+    if (year(utc) != simYear)
+    {
+        printStats();
+        simYear = year(utc);
+    }
+
+    // the conversions done by the Clock and WorldClock sketches
+    uint32_t us = micros();
+    for (uint8_t i=0; i<nZones; i++)
+    {
+        TimeChangeRule *tcr;
+        zones[i]->toLocal(utc, &tcr);
+    }
+    convMicros += micros() - us;
+
+    adjustTime(STEP);
+}
+
+// print and reset the counters for the year just simulated
+void printStats()
+{
+    uint32_t conversions(0), calcs(0), familyHits(0);
+    for (uint8_t i=0; i<nZones; i++)
+    {
+        TimezoneStats s = zones[i]->stats();
+        conversions += s.conversions;
+        calcs += s.calcs;
+        familyHits += s.familyHits;
+        zones[i]->resetStats();
+    }
+
+    char buf[64];
+    sprintf(buf, "%d %12lu %6lu %11lu %8lu", simYear, conversions, calcs, familyHits,
+        conversions ? convMicros / conversions : 0UL);
+    Serial.println(buf);
+    convMicros = 0;
+}
@@ -0,0 +1,155 @@
+/*----------------------------------------------------------------------*
+ * Arduino Timezone Library                                             *
+ * Jack Christensen Mar 2012                                            *
+ *                                                                      *
+ * Arduino Timezone Library Copyright (C) 2018 by Jack Christensen and  *
+ * licensed under GNU GPL v3.0, https://www.gnu.org/licenses/gpl.html   *
+ *----------------------------------------------------------------------*/
+
+#include "BusinessCalendar.h"
+
+/*----------------------------------------------------------------------*
+ * Create a business calendar for the given time zone. Initially it is  *
+ * closed on all days and has no holidays.                              *
+ *----------------------------------------------------------------------*/
+BusinessCalendar::BusinessCalendar(Timezone &tz)
+    : m_tz(tz), m_holidays(0), m_firstDay(0), m_nDays(0)
+{
+    for (uint8_t i=0; i<7; i++) m_hours[i] = 0;
+}
+
+/*----------------------------------------------------------------------*
+ * Set the business hours for the given day of the week (1=Sun ...      *
+ * 7=Sat) as the local hours from startHr up to but not including       *
+ * endHr, e.g. 9 and 17 for 09:00 to 17:00. Set both to zero to close   *
+ * the day.                                                             *
+ *----------------------------------------------------------------------*/
+void BusinessCalendar::setHours(uint8_t dow, uint8_t startHr, uint8_t endHr)
+{
+    uint32_t mask = 0;
+    for (uint8_t h=startHr; h<endHr && h<24; h++) mask |= 1UL << h;
+    setHours(dow, mask);
+}
+
+/*----------------------------------------------------------------------*
+ * Set the business hours for the given day of the week (1=Sun ...      *
+ * 7=Sat) as a mask with bit n set if open during local hour n.         *
+ *----------------------------------------------------------------------*/
+void BusinessCalendar::setHours(uint8_t dow, uint32_t hourMask)
+{
+    if (dow >= 1 && dow <= 7) m_hours[dow - 1] = hourMask & 0xFFFFFFUL;
+}
+
+/*----------------------------------------------------------------------*
+ * Set the holidays as a bitmap of nDays bits, starting with the least  *
+ * significant bit of bitmap[0]. A set bit means that the local day     *
+ * firstDay + n is a holiday. firstDay is any local time_t on the first *
+ * day. The bitmap is not copied and must remain valid.                 *
+ *----------------------------------------------------------------------*/
+void BusinessCalendar::setHolidays(const uint8_t *bitmap, time_t firstDay, uint16_t nDays)
+{
+    m_holidays = bitmap;
+    m_firstDay = firstDay / SECS_PER_DAY;
+    m_nDays = nDays;
+}
+
+/*----------------------------------------------------------------------*
+ * Determine whether the given UTC time is within business hours.       *
+ *----------------------------------------------------------------------*/
+bool BusinessCalendar::isOpen(time_t utc)
+{
+    return isOpenLocal(m_tz.toLocal(utc));
+}
+
+/*----------------------------------------------------------------------*
+ * Determine for each of an array of n UTC times whether it is within   *
+ * business hours. The times are converted in small batches with the    *
+ * batch version of Timezone::toLocal().                                *
+ *----------------------------------------------------------------------*/
+void BusinessCalendar::isOpen(const time_t *utc, bool *open, size_t n)
+{
+    const size_t BATCH = 16;
+    time_t local[BATCH];
+    while (n > 0)
+    {
+        size_t k = n < BATCH ? n : BATCH;
+        m_tz.toLocal(utc, local, k);
+        for (size_t i=0; i<k; i++) open[i] = isOpenLocal(local[i]);
+        utc += k;
+        open += k;
+        n -= k;
+    }
+}
+
+/*----------------------------------------------------------------------*
+ * Return the number of seconds within business hours from utcStart up  *
+ * to but not including utcEnd. Local hours that do not occur when      *
+ * changing to daylight time are not counted, and those that occur      *
+ * twice when changing to standard time are counted twice.              *
+ *----------------------------------------------------------------------*/
+time_t BusinessCalendar::openSeconds(time_t utcStart, time_t utcEnd)
+{
+    time_t total = 0;
+    while (utcStart < utcEnd)
+    {
+        // the offset from UTC is constant up to the next time change
+        time_t spanEnd = m_tz.nextTimeChange(utcStart);
+        if (spanEnd == 0 || spanEnd > utcEnd) spanEnd = utcEnd;
+        time_t offset = m_tz.toLocal(utcStart) - utcStart;
+        time_t local = utcStart + offset;
+        time_t localEnd = spanEnd + offset;
+
+        // add up the business seconds for each local day in the span
+        while (local < localEnd)
+        {
+            uint16_t day = local / SECS_PER_DAY;
+            time_t midnight = (time_t)day * SECS_PER_DAY;
+            time_t end = midnight + SECS_PER_DAY < localEnd ? midnight + SECS_PER_DAY : localEnd;
+            if (!isHoliday(day)) total += openSecondsInDay(day, local - midnight, end - midnight);
+            local = end;
+        }
+        utcStart = spanEnd;
+    }
+    return total;
+}
+
+/*----------------------------------------------------------------------*
+ * Determine whether the given local time is within business hours.     *
+ *----------------------------------------------------------------------*/
+bool BusinessCalendar::isOpenLocal(time_t local)
+{
+    uint16_t day = local / SECS_PER_DAY;
+    uint8_t hr = (local % SECS_PER_DAY) / SECS_PER_HOUR;
+    return (m_hours[(day + 4) % 7] >> hr & 1) && !isHoliday(day);
+}
+
+/*----------------------------------------------------------------------*
+ * Determine whether the given local day (days since 1970) is a holiday.*
+ *----------------------------------------------------------------------*/
+bool BusinessCalendar::isHoliday(uint16_t day)
+{
+    if (m_holidays == 0 || day < m_firstDay) return false;
+    uint16_t n = day - m_firstDay;
+    return n < m_nDays && (m_holidays[n >> 3] >> (n & 7) & 1);
+}
+
+/*----------------------------------------------------------------------*
+ * Return the number of seconds within business hours on the given      *
+ * local day (days since 1970) between the given numbers of seconds     *
+ * after midnight.                                                      *
+ *----------------------------------------------------------------------*/
+time_t BusinessCalendar::openSecondsInDay(uint16_t day, time_t start, time_t end)
+{
+    uint32_t mask = m_hours[(day + 4) % 7];
+    if (mask == 0) return 0;
+
+    time_t total = 0;
+    for (uint8_t h=start / SECS_PER_HOUR; h < 24 && h * SECS_PER_HOUR < end; h++)
+    {
+        if (!(mask >> h & 1)) continue;
+        time_t s = h * SECS_PER_HOUR > start ? h * SECS_PER_HOUR : start;
+        time_t e = (h + 1) * SECS_PER_HOUR < end ? (h + 1) * SECS_PER_HOUR : end;
+        total += e - s;
+    }
+    return total;
+}
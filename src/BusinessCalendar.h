@@ -0,0 +1,36 @@
+/*----------------------------------------------------------------------*
+ * Arduino Timezone Library                                             *
+ * Jack Christensen Mar 2012                                            *
+ *                                                                      *
+ * Arduino Timezone Library Copyright (C) 2018 by Jack Christensen and  *
+ * licensed under GNU GPL v3.0, https://www.gnu.org/licenses/gpl.html   *
+ *----------------------------------------------------------------------*/
+
+#ifndef BUSINESS_CALENDAR_H_INCLUDED
+#define BUSINESS_CALENDAR_H_INCLUDED
+#include "Timezone.h"
+
+// local business hours for each day of the week, with holidays, in a
+// given time zone.
+class BusinessCalendar
+{
+    public:
+        BusinessCalendar(Timezone &tz);
+        void setHours(uint8_t dow, uint8_t startHr, uint8_t endHr);
+        void setHours(uint8_t dow, uint32_t hourMask);
+        void setHolidays(const uint8_t *bitmap, time_t firstDay, uint16_t nDays);
+        bool isOpen(time_t utc);
+        void isOpen(const time_t *utc, bool *open, size_t n);
+        time_t openSeconds(time_t utcStart, time_t utcEnd);
+
+    private:
+        bool isOpenLocal(time_t local);
+        bool isHoliday(uint16_t day);
+        time_t openSecondsInDay(uint16_t day, time_t start, time_t end);
+        Timezone &m_tz;
+        uint32_t m_hours[7];        // bit n set if open during local hour n, Sun to Sat
+        const uint8_t *m_holidays;  // bit n set if local day m_firstDay + n is a holiday
+        uint16_t m_firstDay;        // first day in the holiday bitmap, days since 1970
+        uint16_t m_nDays;           // number of days in the holiday bitmap
+};
+#endif
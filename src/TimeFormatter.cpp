@@ -0,0 +1,90 @@
+/*----------------------------------------------------------------------*
+ * Arduino Timezone Library                                             *
+ * Jack Christensen Mar 2012                                            *
+ *                                                                      *
+ * Arduino Timezone Library Copyright (C) 2018 by Jack Christensen and  *
+ * licensed under GNU GPL v3.0, https://www.gnu.org/licenses/gpl.html   *
+ *----------------------------------------------------------------------*/
+
+#include "TimeFormatter.h"
+
+/*----------------------------------------------------------------------*
+ * Create a formatter for local times in the given time zone. If the    *
+ * zone's rules are changed, call invalidate().                         *
+ *----------------------------------------------------------------------*/
+TimeFormatter::TimeFormatter(Timezone &tz)
+    : m_tz(tz), m_start(0), m_end(0), m_base(0), m_minute(-1)
+{
+    m_buf[0] = '\0';
+}
+
+/*----------------------------------------------------------------------*
+ * Return the local date and time for the given UTC time as text, e.g.  *
+ * "2018-03-11 03:00:00 EDT -04:00". The text is kept in the formatter  *
+ * and is overwritten by the next call.                                 *
+ *----------------------------------------------------------------------*/
+const char *TimeFormatter::format(time_t utc)
+{
+    if (utc < m_start || utc >= m_end) formatPrefix(utc);
+
+    // rewrite the time digits, the seconds only if still the same minute
+    long secs = utc - m_base;
+    int minute = secs / SECS_PER_MIN;
+    if (minute != m_minute)
+    {
+        put2(m_buf + 11, minute / 60);
+        put2(m_buf + 14, minute % 60);
+        m_minute = minute;
+    }
+    put2(m_buf + 17, secs % 60);
+    return m_buf;
+}
+
+/*----------------------------------------------------------------------*
+ * Format the date, abbreviation and offset for the given UTC time and  *
+ * find how long they remain valid: from the given time until the next  *
+ * local midnight or the next time change, whichever is first.          *
+ *----------------------------------------------------------------------*/
+void TimeFormatter::formatPrefix(time_t utc)
+{
+    TimeChangeRule *tcr;
+    time_t local = m_tz.toLocal(utc, &tcr);
+    m_start = utc;
+    m_base = utc - local % SECS_PER_DAY;
+    m_end = m_base + SECS_PER_DAY;
+    time_t change = m_tz.nextTimeChange(utc);
+    if (change != 0 && change < m_end) m_end = change;
+
+    int yr = Timezone::yearOf(local);
+    put2(m_buf, yr / 100);
+    put2(m_buf + 2, yr % 100);
+    m_buf[4] = '-';
+    put2(m_buf + 5, month(local));
+    m_buf[7] = '-';
+    put2(m_buf + 8, day(local));
+    m_buf[10] = ' ';
+    m_buf[13] = ':';
+    m_buf[16] = ':';
+    m_buf[19] = ' ';
+
+    char *p = m_buf + 20;
+    for (uint8_t i=0; i<sizeof(tcr->abbrev) - 1 && tcr->abbrev[i]; i++) *p++ = tcr->abbrev[i];
+    *p++ = ' ';
+    int offset = tcr->offset;
+    *p++ = offset < 0 ? '-' : '+';
+    if (offset < 0) offset = -offset;
+    put2(p, offset / 60);
+    p[2] = ':';
+    put2(p + 3, offset % 60);
+    p[5] = '\0';
+    m_minute = -1;  // all time digits to be written
+}
+
+/*----------------------------------------------------------------------*
+ * Write a number from 0 to 99 as two digits.                           *
+ *----------------------------------------------------------------------*/
+void TimeFormatter::put2(char *p, uint8_t n)
+{
+    p[0] = '0' + n / 10;
+    p[1] = '0' + n % 10;
+}
@@ -0,0 +1,36 @@
+/*----------------------------------------------------------------------*
+ * Arduino Timezone Library                                             *
+ * Jack Christensen Mar 2012                                            *
+ *                                                                      *
+ * Arduino Timezone Library Copyright (C) 2018 by Jack Christensen and  *
+ * licensed under GNU GPL v3.0, https://www.gnu.org/licenses/gpl.html   *
+ *----------------------------------------------------------------------*/
+
+#ifndef TIME_FORMATTER_H_INCLUDED
+#define TIME_FORMATTER_H_INCLUDED
+#include "Timezone.h"
+
+// formats UTC times as local date and time text in a given time zone,
+// e.g. "2018-03-11 03:00:00 EDT -04:00". the date, abbreviation and
+// offset are formatted once per local day or time change, and only the
+// digits of the time are rewritten for each call.
+class TimeFormatter
+{
+    public:
+        TimeFormatter(Timezone &tz);
+        const char *format(time_t utc);
+        void invalidate() { m_end = 0; }
+
+    private:
+        void formatPrefix(time_t utc);
+        static void put2(char *p, uint8_t n);
+        Timezone &m_tz;
+        time_t m_start;         // the text's date and offset are valid from this UTC time
+        time_t m_end;           // up to this UTC time
+        time_t m_base;          // UTC time of local midnight at the current offset
+        int m_minute;           // minutes after local midnight last formatted
+        // the text: date at 0, time at 11, abbreviation at 20, then " +HH:MM"
+        // and the terminator, i.e. "yyyy-mm-dd hh:mm:ss CHADT +13:45"
+        char m_buf[20 + sizeof(TimeChangeRule::abbrev) - 1 + 7 + 1];
+};
+#endif
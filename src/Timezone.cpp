@@ -10,15 +10,117 @@
 
 #ifdef __AVR__
     #include <avr/eeprom.h>
+    #include <avr/pgmspace.h>
 #endif
+#ifndef PROGMEM
+    #define PROGMEM
+#endif
+#ifndef pgm_read_word
+    #define pgm_read_word(addr) (*(const uint16_t *)(addr))
+#endif
+
+// start of each year from 1970 to 2106, the range of an unsigned 32-bit
+// time_t, as days since 1970. used by yearOf(), yearStart() and
+// daysFromCivil().
+#define TZ_FIRST_YEAR 1970
+#define TZ_YEARS 137
+static const uint16_t tzMonthDays[12] PROGMEM = {     // days before each month
+    0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334
+};
+static const uint16_t tzYearDays[TZ_YEARS] PROGMEM = {
+    0, 365, 730, 1096, 1461, 1826, 2191, 2557, 2922, 3287,
+    3652, 4018, 4383, 4748, 5113, 5479, 5844, 6209, 6574, 6940,
+    7305, 7670, 8035, 8401, 8766, 9131, 9496, 9862, 10227, 10592,
+    10957, 11323, 11688, 12053, 12418, 12784, 13149, 13514, 13879, 14245,
+    14610, 14975, 15340, 15706, 16071, 16436, 16801, 17167, 17532, 17897,
+    18262, 18628, 18993, 19358, 19723, 20089, 20454, 20819, 21184, 21550,
+    21915, 22280, 22645, 23011, 23376, 23741, 24106, 24472, 24837, 25202,
+    25567, 25933, 26298, 26663, 27028, 27394, 27759, 28124, 28489, 28855,
+    29220, 29585, 29950, 30316, 30681, 31046, 31411, 31777, 32142, 32507,
+    32872, 33238, 33603, 33968, 34333, 34699, 35064, 35429, 35794, 36160,
+    36525, 36890, 37255, 37621, 37986, 38351, 38716, 39082, 39447, 39812,
+    40177, 40543, 40908, 41273, 41638, 42004, 42369, 42734, 43099, 43465,
+    43830, 44195, 44560, 44926, 45291, 45656, 46021, 46387, 46752, 47117,
+    47482, 47847, 48212, 48577, 48942, 49308, 49673
+};
+
+// local time change points shared by zones of the same family, i.e. whose
+// rules have the same week, dow, month and hour (e.g. US Eastern, Central,
+// Mountain and Pacific). the change points in local time do not depend on
+// the offsets, so they are calculated once per family and year.
+struct tzSchedule_t         // the schedule fields of a TimeChangeRule
+{
+    uint8_t week;
+    uint8_t dow;
+    uint8_t month;
+    uint8_t hour;
+};
+
+struct tzFamily_t
+{
+    tzSchedule_t dst;
+    tzSchedule_t std;
+    int yr;                 // year the change points were calculated for, 0 if unused
+    time_t dstLoc;
+    time_t stdLoc;
+};
+#if TZ_FAMILY_SLOTS > TZ_FAMILY_WAYS
+    #define TZ_WAYS TZ_FAMILY_WAYS
+#else
+    #define TZ_WAYS TZ_FAMILY_SLOTS
+#endif
+#define TZ_SETS (TZ_FAMILY_SLOTS / TZ_WAYS)
+static tzFamily_t tzFamily[TZ_SETS][TZ_WAYS];
+static uint8_t tzFamilyNext[TZ_SETS];   // next slot to replace in each set
+static volatile uint8_t tzFamilyBusy;   // tzFamily is being read or updated
+
+static bool isSchedule(const tzSchedule_t &s, const TimeChangeRule &r)
+{
+    return s.week == r.week && s.dow == r.dow && s.month == r.month && s.hour == r.hour;
+}
+
+static void setSchedule(tzSchedule_t &s, const TimeChangeRule &r)
+{
+    s.week = r.week;
+    s.dow = r.dow;
+    s.month = r.month;
+    s.hour = r.hour;
+}
+
+#if TZ_INSTRUMENT
+    #define TZ_COUNT(counter, n) (m_stats.counter += (n))
+    #define TZ_CAPTURE(op, t) do { if (s_capture) s_capture(this, (op), (t)); } while (0)
+    tzCapture_t Timezone::s_capture;
+#else
+    #define TZ_COUNT(counter, n)
+    #define TZ_CAPTURE(op, t)
+#endif
+
+#if TZ_VERIFY
+    #define TZ_VERIFIED(dst, t, local) verified((dst), (t), (local))
+#else
+    #define TZ_VERIFIED(dst, t, local) (dst)
+#endif
+
+// keeps the compiler from moving memory accesses across this point
+#define TZ_BARRIER() __asm__ __volatile__ ("" ::: "memory")
 
 /*----------------------------------------------------------------------*
  * Create a Timezone object from the given time change rules.           *
  *----------------------------------------------------------------------*/
 Timezone::Timezone(TimeChangeRule dstStart, TimeChangeRule stdStart)
-    : m_dst(dstStart), m_std(stdStart)
+    : m_dst(dstStart), m_std(stdStart), m_table(0)
 {
         initTimeChanges();
+#if TZ_INSTRUMENT
+        resetStats();
+#endif
+#if TZ_VERIFY
+        setVerify(TZ_VERIFY_RATE);
+#endif
+#if TZ_ADAPTIVE
+        setEngine(TzAuto);
+#endif
 }
 
 /*----------------------------------------------------------------------*
@@ -26,9 +128,18 @@ Timezone::Timezone(TimeChangeRule dstStart, TimeChangeRule stdStart)
  * daylight time.                                                       *
  *----------------------------------------------------------------------*/
 Timezone::Timezone(TimeChangeRule stdTime)
-    : m_dst(stdTime), m_std(stdTime)
+    : m_dst(stdTime), m_std(stdTime), m_table(0)
 {
         initTimeChanges();
+#if TZ_INSTRUMENT
+        resetStats();
+#endif
+#if TZ_VERIFY
+        setVerify(TZ_VERIFY_RATE);
+#endif
+#if TZ_ADAPTIVE
+        setEngine(TzAuto);
+#endif
 }
 
 #ifdef __AVR__
@@ -37,8 +148,18 @@ Timezone::Timezone(TimeChangeRule stdTime)
  * at the given address.                                                *
  *----------------------------------------------------------------------*/
 Timezone::Timezone(int address)
+    : m_table(0)
 {
     readRules(address);
+#if TZ_INSTRUMENT
+    resetStats();
+#endif
+#if TZ_VERIFY
+    setVerify(TZ_VERIFY_RATE);
+#endif
+#if TZ_ADAPTIVE
+    setEngine(TzAuto);
+#endif
 }
 #endif
 
@@ -48,13 +169,13 @@ Timezone::Timezone(int address)
  *----------------------------------------------------------------------*/
 time_t Timezone::toLocal(time_t utc)
 {
-    // recalculate the time change points if needed
-    if (year(utc) != year(m_dstUTC)) calcTimeChanges(year(utc));
+    TZ_COUNT(conversions, 1);
+    TZ_CAPTURE(TzToLocal, utc);
 
-    if (utcIsDST(utc))
-        return utc + m_dst.offset * SECS_PER_MIN;
+    if (TZ_VERIFIED(utcDST(utc), utc, false))
+        return utc + m_dstOffset;
     else
-        return utc + m_std.offset * SECS_PER_MIN;
+        return utc + m_stdOffset;
 }
 
 /*----------------------------------------------------------------------*
@@ -65,19 +186,111 @@ time_t Timezone::toLocal(time_t utc)
  *----------------------------------------------------------------------*/
 time_t Timezone::toLocal(time_t utc, TimeChangeRule **tcr)
 {
-    // recalculate the time change points if needed
-    if (year(utc) != year(m_dstUTC)) calcTimeChanges(year(utc));
+    TZ_COUNT(conversions, 1);
+    TZ_CAPTURE(TzToLocal, utc);
 
-    if (utcIsDST(utc)) {
+    if (TZ_VERIFIED(utcDST(utc), utc, false)) {
         *tcr = &m_dst;
-        return utc + m_dst.offset * SECS_PER_MIN;
+        return utc + m_dstOffset;
     }
     else {
         *tcr = &m_std;
-        return utc + m_std.offset * SECS_PER_MIN;
+        return utc + m_stdOffset;
+    }
+}
+
+/*----------------------------------------------------------------------*
+ * Determine whether one time of a batch is DST, for the batch          *
+ * functions. r holds the range test for the year of the previous time  *
+ * (start with range_t()), and is replaced when t is in another year.   *
+ * r and scratch are the caller's private copies, see timeChanges().    *
+ *----------------------------------------------------------------------*/
+inline bool Timezone::rangeDST(range_t &r, changes_t *scratch, time_t t, bool local, uint8_t op)
+{
+    TZ_CAPTURE(op, t);
+    (void)op;               // used only by TZ_CAPTURE
+    if (m_shape != ShapeFixed && (t < r.yrStart || t >= r.yrEnd)) r = dstRange(timeChanges(t, scratch), local);
+    return TZ_VERIFIED(inRange(r, t), t, local);
+}
+
+/*----------------------------------------------------------------------*
+ * Convert an array of n UTC times to local times. The time changes     *
+ * are checked once per year rather than once per time, so this is      *
+ * much faster than calling toLocal() for each element. utc and local   *
+ * may be the same array.                                               *
+ *----------------------------------------------------------------------*/
+void Timezone::toLocal(const time_t *utc, time_t *local, size_t n)
+{
+    TZ_COUNT(conversions, n);
+    range_t r = range_t();
+    changes_t scratch;
+    for (size_t i=0; i<n; i++)
+    {
+        time_t t = utc[i];
+        if (rangeDST(r, &scratch, t, false, TzToLocal))
+            local[i] = t + m_dstOffset;
+        else
+            local[i] = t + m_stdOffset;
     }
 }
 
+/*----------------------------------------------------------------------*
+ * Convert an array of n UTC times to local times and break each into   *
+ * its calendar fields, writing each field to its own array (NULL       *
+ * arrays are skipped). The date is calculated without loops, and only  *
+ * when the local day differs from the previous time's, so sorted       *
+ * times cost little more than the conversion itself.                   *
+ *----------------------------------------------------------------------*/
+void Timezone::breakLocal(const time_t *utc, const LocalFields &fields, size_t n)
+{
+    TZ_COUNT(conversions, n);
+    range_t r = range_t();
+    changes_t scratch;
+    long lastDay = -1;
+    int yr = 0;
+    uint8_t mon = 0, day = 0, wday = 0;
+    for (size_t i=0; i<n; i++)
+    {
+        time_t t = utc[i];
+        time_t local = t + (rangeDST(r, &scratch, t, false, TzToLocal) ? m_dstOffset : m_stdOffset);
+
+        long days = local / SECS_PER_DAY;
+        if (days != lastDay)
+        {
+            civilFromDays(days, &yr, &mon, &day);
+            wday = (days + 4) % DAYS_PER_WEEK + 1;  // 1 Jan 1970 was a Thursday
+            lastDay = days;
+        }
+        long secs = local - days * SECS_PER_DAY;
+        if (fields.year) fields.year[i] = yr;
+        if (fields.month) fields.month[i] = mon;
+        if (fields.day) fields.day[i] = day;
+        if (fields.hour) fields.hour[i] = secs / SECS_PER_HOUR;
+        if (fields.minute) fields.minute[i] = secs / SECS_PER_MIN % 60;
+        if (fields.second) fields.second[i] = secs % 60;
+        if (fields.wday) fields.wday[i] = wday;
+    }
+}
+
+/*----------------------------------------------------------------------*
+ * Convert a block of UTC times stored as a base time plus deltas of    *
+ * 0 to span seconds, e.g. a frame-of-reference compressed block.       *
+ * If the whole block falls between two time changes, the base is       *
+ * converted to local time in place, the deltas remain valid as they    *
+ * are, and true is returned. If a time change occurs within the block, *
+ * the base is left unchanged and false is returned; the caller should  *
+ * split the block at nextTimeChange(base) or convert it element-wise.  *
+ *----------------------------------------------------------------------*/
+bool Timezone::toLocalBlock(time_t *base, time_t span)
+{
+    time_t utc = *base;
+    time_t local = toLocal(utc);
+    time_t next = nextTimeChange(utc);
+    if (next != 0 && span >= next - utc) return false;
+    *base = local;
+    return true;
+}
+
 /*----------------------------------------------------------------------*
  * Convert the given local time to UTC time.                            *
  *                                                                      *
@@ -105,13 +318,263 @@ time_t Timezone::toLocal(time_t utc, TimeChangeRule **tcr)
  *----------------------------------------------------------------------*/
 time_t Timezone::toUTC(time_t local)
 {
-    // recalculate the time change points if needed
-    if (year(local) != year(m_dstLoc)) calcTimeChanges(year(local));
+    TZ_COUNT(conversions, 1);
+    TZ_CAPTURE(TzToUTC, local);
 
-    if (locIsDST(local))
-        return local - m_dst.offset * SECS_PER_MIN;
+    // get the time change points, recalculating them if needed
+    changes_t scratch;
+    bool dst = m_shape != ShapeFixed && inRange(dstRange(timeChanges(local, &scratch), true), local);
+
+    if (TZ_VERIFIED(dst, local, true))
+        return local - m_dstOffset;
     else
-        return local - m_std.offset * SECS_PER_MIN;
+        return local - m_stdOffset;
+}
+
+/*----------------------------------------------------------------------*
+ * Convert an array of n local times to UTC times, as toUTC() does.     *
+ * The same cautions apply. local and utc may be the same array.        *
+ *----------------------------------------------------------------------*/
+void Timezone::toUTC(const time_t *local, time_t *utc, size_t n)
+{
+    TZ_COUNT(conversions, n);
+    range_t r = range_t();
+    changes_t scratch;
+    for (size_t i=0; i<n; i++)
+    {
+        time_t t = local[i];
+        if (rangeDST(r, &scratch, t, true, TzToUTC))
+            utc[i] = t - m_dstOffset;
+        else
+            utc[i] = t - m_stdOffset;
+    }
+}
+
+/*----------------------------------------------------------------------*
+ * Return the UTC time of the first time change after the given UTC     *
+ * time, or zero if daylight time is not observed in this tz.           *
+ *----------------------------------------------------------------------*/
+time_t Timezone::nextTimeChange(time_t utc)
+{
+    changes_t scratch;
+    const changes_t *c = timeChanges(utc, &scratch);
+    if (c->stdUTC == c->dstUTC) return 0;
+
+    // look at this year's time changes, then at next year's
+    for (uint8_t i=0; i<2; i++)
+    {
+        time_t first = c->dstUTC < c->stdUTC ? c->dstUTC : c->stdUTC;
+        time_t second = c->dstUTC < c->stdUTC ? c->stdUTC : c->dstUTC;
+        if (first > utc) return first;
+        if (second > utc) return second;
+        calcTimeChanges(yearOf(utc) + 1, &scratch);  // next year's, leave the cached ones
+        c = &scratch;
+    }
+    return 0;
+}
+
+/*----------------------------------------------------------------------*
+ * Return the UTC time of the first occurrence of the given local time  *
+ * of day (hour and minute) after the given UTC time. This is the time  *
+ * to arm a timer for a daily event at a local wall-clock time; after   *
+ * the event, call again to get the next one.                           *
+ * A local time that occurs twice when changing to standard time        *
+ * occurs only at its first occurrence. A local time that does not      *
+ * exist when changing to daylight time occurs at the time change.      *
+ *----------------------------------------------------------------------*/
+time_t Timezone::nextLocalTime(time_t utc, uint8_t hr, uint8_t mn)
+{
+    time_t local = toLocal(utc);
+    time_t target = previousMidnight(local) + hr * SECS_PER_HOUR + mn * SECS_PER_MIN;
+    if (target <= local) target += SECS_PER_DAY;
+
+    for (;;)
+    {
+        time_t t = localToUTC(target);
+        if (t > utc) return t;
+        target += SECS_PER_DAY;     // today's already occurred, e.g. first of a repeated hour
+    }
+}
+
+/*----------------------------------------------------------------------*
+ * Write to ticks the UTC times of the local calendar boundaries of the *
+ * given unit (Hourly, Daily, Weekly or Monthly) from utcStart up to    *
+ * but not including utcEnd, e.g. for the ticks of a chart axis. Weeks  *
+ * start on Sunday. Returns the number of ticks written, at most max;   *
+ * if the buffer fills, call again with utcStart one second after the   *
+ * last tick returned.                                                  *
+ * Works through the spans between time changes, in each of which the   *
+ * local boundaries are found by calendar arithmetic. An hour that      *
+ * occurs twice gets two ticks and an hour that does not exist gets     *
+ * none. A day, week or month that starts in a repeated hour gets only  *
+ * the first tick, and one that starts in a skipped hour gets a tick at *
+ * the time change.                                                     *
+ *----------------------------------------------------------------------*/
+uint16_t Timezone::localTicks(time_t utcStart, time_t utcEnd, uint8_t unit, time_t *ticks, uint16_t max)
+{
+    uint16_t n = 0;
+    time_t t = utcStart;
+
+    // find whether the first span started with a time change
+    time_t change = nextTimeChange(t - SECS_PER_DAY);
+    bool atChange = change != 0 && change <= t;
+    if (!atChange) change = t;
+
+    while (t < utcEnd && n < max)
+    {
+        // the span from t to the next time change or utcEnd
+        time_t spanEnd = nextTimeChange(t);
+        if (spanEnd == 0 || spanEnd > utcEnd) spanEnd = utcEnd;
+        time_t offset = toLocal(t) - t;
+        time_t local = t + offset;
+        time_t localEnd = spanEnd + offset;
+
+        if (atChange && unit != Hourly)
+        {
+            time_t prevLocal = toLocal(change - 1) + 1;     // end of the previous span
+            time_t spanLocal = change + offset;
+            if (spanLocal > prevLocal)      // local times skipped, tick at the change
+            {
+                if (change >= utcStart && nextTick(prevLocal - 1, unit) < spanLocal)
+                    ticks[n++] = change;
+            }
+            else if (local < prevLocal)     // local times repeated, tick only the first time
+                local = prevLocal;
+        }
+
+        for (time_t b = nextTick(local - 1, unit); b < localEnd && n < max; b = nextTick(b, unit))
+            ticks[n++] = b - offset;
+
+        t = change = spanEnd;
+        atChange = true;
+    }
+    return n;
+}
+
+/*----------------------------------------------------------------------*
+ * Return the number of local calendar hours, days, weeks (starting on  *
+ * Sunday) or months (unit Hourly, Daily, Weekly or Monthly) from utcA  *
+ * to utcB, i.e. how many boundaries of that unit are crossed going     *
+ * from one local time to the other. Negative if utcB is before utcA.   *
+ *----------------------------------------------------------------------*/
+long Timezone::localDifference(time_t utcA, time_t utcB, uint8_t unit)
+{
+    return calendarIndex(toLocal(utcB), unit) - calendarIndex(toLocal(utcA), unit);
+}
+
+/*----------------------------------------------------------------------*
+ * Calculate localDifference() for each of n pairs of UTC times from    *
+ * the arrays utcA and utcB. The times are converted in small batches   *
+ * with the batch version of toLocal(), and the differences are found   *
+ * from day numbers without breaking down the times.                    *
+ *----------------------------------------------------------------------*/
+void Timezone::localDifference(const time_t *utcA, const time_t *utcB, long *diff, size_t n, uint8_t unit)
+{
+    const size_t BATCH = 16;
+    time_t a[BATCH], b[BATCH];
+    while (n > 0)
+    {
+        size_t k = n < BATCH ? n : BATCH;
+        toLocal(utcA, a, k);
+        toLocal(utcB, b, k);
+        for (size_t i=0; i<k; i++) diff[i] = calendarIndex(b[i], unit) - calendarIndex(a[i], unit);
+        utcA += k;
+        utcB += k;
+        diff += k;
+        n -= k;
+    }
+}
+
+/*----------------------------------------------------------------------*
+ * Find the UTC intervals from utcStart to utcEnd that are within all   *
+ * of the given daily local windows, each in its own time zone, e.g.    *
+ * when everyone in a meeting is within local working hours. Writes up  *
+ * to max intervals as their start and (exclusive) end times and        *
+ * returns the number written. If the arrays fill, call again with      *
+ * utcStart set to the last end time to continue.                       *
+ * Takes time proportional to the number of days times the number of   *
+ * windows: from a given time, each zone's next window is found, and    *
+ * either the windows overlap, or no common time can exist before the   *
+ * latest window start, so the search continues from there.             *
+ *----------------------------------------------------------------------*/
+uint16_t Timezone::overlap(const LocalWindow *windows, uint8_t nWindows, time_t utcStart, time_t utcEnd,
+    time_t *starts, time_t *ends, uint16_t max)
+{
+    uint16_t n = 0;
+    time_t t = utcStart;
+    while (t < utcEnd)
+    {
+        time_t s = t, e = utcEnd;
+        for (uint8_t i=0; i<nWindows; i++)
+        {
+            time_t ws, we;
+            windows[i].tz->nextWindow(t, windows[i].start, windows[i].end, &ws, &we);
+            if (ws > s) s = ws;
+            if (we < e) e = we;
+        }
+
+        if (s < e)
+        {
+            if (n > 0 && ends[n - 1] == s)  // continues the previous interval
+                ends[n - 1] = e;
+            else if (n < max)
+            {
+                starts[n] = s;
+                ends[n++] = e;
+            }
+            else
+                break;
+            t = e;
+        }
+        else
+            t = s;
+    }
+    return n;
+}
+
+/*----------------------------------------------------------------------*
+ * Find the UTC intervals from utcStart to utcEnd in which two time     *
+ * zones, e.g. the old and new rules of a zone whose rules are being    *
+ * changed, give different offsets or abbreviations. Writes up to max   *
+ * intervals as their start and (exclusive) end times and returns the   *
+ * number written. If the arrays fill, call again with utcStart set to  *
+ * the last end time to continue.                                       *
+ * The range is divided at each zone's time changes, between which      *
+ * neither zone changes, so the time taken is proportional to the       *
+ * number of time changes.                                              *
+ *----------------------------------------------------------------------*/
+uint16_t Timezone::differences(Timezone &tz1, Timezone &tz2, time_t utcStart, time_t utcEnd,
+    time_t *starts, time_t *ends, uint16_t max)
+{
+    uint16_t n = 0;
+    time_t t = utcStart;
+    while (t < utcEnd)
+    {
+        // the end of the span in which neither zone changes
+        time_t e = utcEnd;
+        time_t c1 = tz1.nextTimeChange(t);
+        time_t c2 = tz2.nextTimeChange(t);
+        if (c1 != 0 && c1 < e) e = c1;
+        if (c2 != 0 && c2 < e) e = c2;
+
+        TimeChangeRule *r1, *r2;
+        tz1.toLocal(t, &r1);
+        tz2.toLocal(t, &r2);
+        if (r1->offset != r2->offset || strncmp(r1->abbrev, r2->abbrev, sizeof(r1->abbrev)) != 0)
+        {
+            if (n > 0 && ends[n - 1] == t)  // continues the previous interval
+                ends[n - 1] = e;
+            else if (n < max)
+            {
+                starts[n] = t;
+                ends[n++] = e;
+            }
+            else
+                break;
+        }
+        t = e;
+    }
+    return n;
 }
 
 /*----------------------------------------------------------------------*
@@ -120,15 +583,22 @@ time_t Timezone::toUTC(time_t local)
  *----------------------------------------------------------------------*/
 bool Timezone::utcIsDST(time_t utc)
 {
-    // recalculate the time change points if needed
-    if (year(utc) != year(m_dstUTC)) calcTimeChanges(year(utc));
+    TZ_COUNT(conversions, 1);
+    TZ_CAPTURE(TzUtcIsDST, utc);
 
-    if (m_stdUTC == m_dstUTC)       // daylight time not observed in this tz
-        return false;
-    else if (m_stdUTC > m_dstUTC)   // northern hemisphere
-        return (utc >= m_dstUTC && utc < m_stdUTC);
-    else                            // southern hemisphere
-        return !(utc >= m_stdUTC && utc < m_dstUTC);
+    return TZ_VERIFIED(utcDST(utc), utc, false);
+}
+
+/*----------------------------------------------------------------------*
+ * Determine for each of an array of n UTC times whether it is within   *
+ * the DST interval.                                                    *
+ *----------------------------------------------------------------------*/
+void Timezone::utcIsDST(const time_t *utc, bool *dst, size_t n)
+{
+    TZ_COUNT(conversions, n);
+    range_t r = range_t();
+    changes_t scratch;
+    for (size_t i=0; i<n; i++) dst[i] = rangeDST(r, &scratch, utc[i], false, TzUtcIsDST);
 }
 
 /*----------------------------------------------------------------------*
@@ -137,27 +607,439 @@ bool Timezone::utcIsDST(time_t utc)
  *----------------------------------------------------------------------*/
 bool Timezone::locIsDST(time_t local)
 {
-    // recalculate the time change points if needed
-    if (year(local) != year(m_dstLoc)) calcTimeChanges(year(local));
+    TZ_COUNT(conversions, 1);
+    TZ_CAPTURE(TzLocIsDST, local);
+
+    // get the time change points, recalculating them if needed
+    changes_t scratch;
+    bool dst = m_shape != ShapeFixed && inRange(dstRange(timeChanges(local, &scratch), true), local);
+
+    return TZ_VERIFIED(dst, local, true);
+}
+
+/*----------------------------------------------------------------------*
+ * Determine for each of an array of n UTC times whether it is within   *
+ * the DST interval, setting bit i % 8 of mask[i / 8] if so. The mask   *
+ * must have room for (n + 7) / 8 bytes; unused bits of the last byte   *
+ * are cleared.                                                         *
+ *----------------------------------------------------------------------*/
+void Timezone::utcDSTMask(const time_t *utc, uint8_t *mask, size_t n)
+{
+    dstMask(utc, mask, n, false);
+}
+
+/*----------------------------------------------------------------------*
+ * Determine for each of an array of n local times whether it is        *
+ * within the DST interval, as a mask like utcDSTMask().                *
+ *----------------------------------------------------------------------*/
+void Timezone::locDSTMask(const time_t *local, uint8_t *mask, size_t n)
+{
+    dstMask(local, mask, n, true);
+}
+
+/*----------------------------------------------------------------------*
+ * Count the bits set in the first n bits of a mask, e.g. the number    *
+ * of DST times found by utcDSTMask().                                  *
+ *----------------------------------------------------------------------*/
+size_t Timezone::countBits(const uint8_t *mask, size_t n)
+{
+    size_t count = 0;
+    size_t bytes = n / 8;
+    for (size_t i=0; i<bytes; i++) count += __builtin_popcount(mask[i]);
+    if (n % 8) count += __builtin_popcount(mask[bytes] & ((1 << (n % 8)) - 1));
+    return count;
+}
+
+/*----------------------------------------------------------------------*
+ * Build the DST mask for utcDSTMask() or locDSTMask().                 *
+ *----------------------------------------------------------------------*/
+void Timezone::dstMask(const time_t *t, uint8_t *mask, size_t n, bool local)
+{
+    TZ_COUNT(conversions, n);
+    range_t r = range_t();
+    changes_t scratch;
+    uint8_t op = local ? TzLocIsDST : TzUtcIsDST;
+    uint8_t bits = 0;
+    for (size_t i=0; i<n; i++)
+    {
+        bits |= (uint8_t)rangeDST(r, &scratch, t[i], local, op) << (i % 8);
+        if (i % 8 == 7)
+        {
+            mask[i / 8] = bits;
+            bits = 0;
+        }
+    }
+    if (n % 8) mask[n / 8] = bits;
+}
+
+/*----------------------------------------------------------------------*
+ * Determine whether the given UTC time_t is within the DST interval,   *
+ * for the single-value conversions. With TZ_ADAPTIVE, either looks it  *
+ * up in the year's time change points (TzYearCache), or checks whether *
+ * it is in the same span between time changes as the previous time    *
+ * (TzCursor), which is quicker for times that mostly increase.         *
+ *----------------------------------------------------------------------*/
+bool Timezone::utcDST(time_t utc)
+{
+    if (m_shape == ShapeFixed) return false;
+
+#if TZ_ADAPTIVE
+    if (m_using == TzCursor)
+    {
+        const span_t *s = &m_span[m_spanActive];
+        if ((unsigned long)(utc - s->start) < (unsigned long)s->len)
+        {
+            adapt(true);
+            return s->dst;
+        }
+    }
+#endif
+
+    // get the time change points, recalculating them if needed
+    changes_t scratch;
+    const changes_t *c = timeChanges(utc, &scratch);
+    bool dst = inRange(dstRange(c, false), utc);
+
+#if TZ_ADAPTIVE
+    if (m_using == TzCursor)
+    {
+        moveSpan(c, utc, dst);
+        adapt(false);
+    }
+    else
+    {
+        adapt(utc >= m_lastUTC && utc - m_lastUTC < SECS_PER_DAY);  // would the cursor likely hit
+        m_lastUTC = utc;
+    }
+#endif
+    return dst;
+}
+
+#if TZ_ADAPTIVE
+/*----------------------------------------------------------------------*
+ * Move the cursor to the span between time changes containing the     *
+ * given UTC time, given the time change points for its year. The span  *
+ * is double buffered like the time change points, see timeChanges();   *
+ * an ISR that interrupts an update leaves the cursor alone.            *
+ *----------------------------------------------------------------------*/
+void Timezone::moveSpan(const changes_t *c, time_t utc, bool dst)
+{
+    if (m_spanBusy) return;
+    m_spanBusy = 1;
+
+    time_t start = c->yrStart;
+    time_t end = c->yrEnd;
+    if (c->stdUTC != c->dstUTC)
+    {
+        time_t first = c->dstUTC < c->stdUTC ? c->dstUTC : c->stdUTC;
+        time_t second = c->dstUTC < c->stdUTC ? c->stdUTC : c->dstUTC;
+        if (utc < first)
+            end = first;
+        else if (utc < second)
+        {
+            start = first;
+            end = second;
+        }
+        else
+            start = second;
+    }
+
+    uint8_t i = m_spanActive ^ 1;
+    m_span[i].start = start;
+    m_span[i].len = end - start;
+    m_span[i].dst = dst;
+    TZ_BARRIER();
+    m_spanActive = i;
+    m_spanBusy = 0;
+}
+
+/*----------------------------------------------------------------------*
+ * Empty the cursor, e.g. after the time change points change.          *
+ *----------------------------------------------------------------------*/
+void Timezone::resetSpan()
+{
+    m_span[0].len = 0;
+    m_span[1].len = 0;
+}
+
+/*----------------------------------------------------------------------*
+ * Count a conversion as suiting the cursor (good) or not, and with     *
+ * TzAuto, choose the engine after every TZ_ADAPT_WINDOW conversions:   *
+ * the cursor when nearly all recent times fell in the same span as     *
+ * the previous one, as for a clock, otherwise the year cache, as for   *
+ * times spread over many years.                                        *
+ *----------------------------------------------------------------------*/
+void Timezone::adapt(bool good)
+{
+    if (good) m_score++;
+    if (++m_window < TZ_ADAPT_WINDOW) return;
+
+    if (m_engine == TzAuto)
+    {
+        uint8_t next = m_using;
+        if (m_using == TzCursor && m_score < TZ_ADAPT_WINDOW * 3 / 4)
+            next = TzYearCache;
+        else if (m_using == TzYearCache && m_score >= TZ_ADAPT_WINDOW * 7 / 8)
+            next = TzCursor;
+        if (next != m_using)
+        {
+            resetSpan();
+            m_using = next;
+            TZ_COUNT(engineSwitches, 1);
+        }
+    }
+    m_window = 0;
+    m_score = 0;
+}
+
+/*----------------------------------------------------------------------*
+ * Set how the single-value conversions find whether a time is DST:     *
+ * TzAuto to choose from the recent inputs, or TzYearCache or TzCursor  *
+ * to use only that engine.                                             *
+ *----------------------------------------------------------------------*/
+void Timezone::setEngine(uint8_t engine)
+{
+    m_engine = engine;
+    m_using = engine;
+    if (engine == TzAuto) m_using = TzYearCache;    // until the inputs show otherwise
+    m_window = 0;
+    m_score = 0;
+    m_lastUTC = 0;
+    m_spanActive = 0;
+    m_spanBusy = 0;
+    resetSpan();
+}
+#endif
+
+/*----------------------------------------------------------------------*
+ * Reduce the DST interval of a year, in UTC or local time, to a range  *
+ * test for the conversions: a start, a length, and whether DST is      *
+ * outside the range, so that each time is tested with one unsigned     *
+ * comparison and no branches. The zone's shape decides how, so the     *
+ * hemisphere is not tested for each year.                              *
+ *----------------------------------------------------------------------*/
+Timezone::range_t Timezone::dstRange(const changes_t *c, bool local)
+{
+    range_t r;
+    r.yrStart = c->yrStart;
+    r.yrEnd = c->yrEnd;
+    r.start = 0;
+    r.len = 0;
+    r.invert = false;
+    time_t dst = local ? c->dstUTC + m_stdOffset : c->dstUTC;
+    time_t std = local ? c->stdUTC + m_dstOffset : c->stdUTC;
+    uint8_t shape = m_shape;
+    if (shape == ShapeGeneric)
+        shape = c->stdUTC == c->dstUTC ? ShapeFixed : std > dst ? ShapeNorthern : ShapeSouthern;
+
+    if (shape == ShapeNorthern)
+    {
+        r.start = dst;
+        r.len = std - dst;
+    }
+    else if (shape == ShapeSouthern)
+    {
+        r.start = std;
+        r.len = dst - std;
+        r.invert = true;
+    }
+    return r;
+}
 
-    if (m_stdUTC == m_dstUTC)       // daylight time not observed in this tz
+/*----------------------------------------------------------------------*
+ * Classify the rules by shape: fixed offset (no daylight time),        *
+ * northern hemisphere (DST starts earlier in the year than standard    *
+ * time), southern hemisphere, or generic when that cannot be told      *
+ * from the rules alone, e.g. both changes in the same month.           *
+ *----------------------------------------------------------------------*/
+void Timezone::classify()
+{
+    if (sameSchedule(m_dst, m_std))
+        m_shape = m_dst.offset == m_std.offset ? ShapeFixed : ShapeGeneric;
+    else if (m_dst.month < m_std.month)
+        m_shape = ShapeNorthern;
+    else if (m_dst.month > m_std.month)
+        m_shape = ShapeSouthern;
+    else
+        m_shape = ShapeGeneric;
+}
+
+#if TZ_VERIFY
+/*----------------------------------------------------------------------*
+ * Determine whether the given UTC time_t is within the DST interval,   *
+ * given the time change points for its year, by the plain comparisons  *
+ * that verify() checks the conversions against.                        *
+ *----------------------------------------------------------------------*/
+bool Timezone::utcInDST(const changes_t *c, time_t utc)
+{
+    if (c->stdUTC == c->dstUTC)         // daylight time not observed in this tz
         return false;
-    else if (m_stdLoc > m_dstLoc)   // northern hemisphere
-        return (local >= m_dstLoc && local < m_stdLoc);
-    else                            // southern hemisphere
-        return !(local >= m_stdLoc && local < m_dstLoc);
+    else if (c->stdUTC > c->dstUTC)     // northern hemisphere
+        return (utc >= c->dstUTC && utc < c->stdUTC);
+    else                                // southern hemisphere
+        return !(utc >= c->stdUTC && utc < c->dstUTC);
+}
+
+/*----------------------------------------------------------------------*
+ * Determine whether the given Local time_t is within the DST interval, *
+ * given the time change points for its year, as utcInDST() does.       *
+ *----------------------------------------------------------------------*/
+bool Timezone::locInDST(const changes_t *c, time_t local)
+{
+    time_t dstLoc = c->dstUTC + m_stdOffset;
+    time_t stdLoc = c->stdUTC + m_dstOffset;
+    if (c->stdUTC == c->dstUTC)         // daylight time not observed in this tz
+        return false;
+    else if (stdLoc > dstLoc)           // northern hemisphere
+        return (local >= dstLoc && local < stdLoc);
+    else                                // southern hemisphere
+        return !(local >= stdLoc && local < dstLoc);
+}
+#endif
+
+/*----------------------------------------------------------------------*
+ * Return the time change points for the year containing the given      *
+ * time_t (UTC or local), recalculating them if needed.                 *
+ *                                                                      *
+ * The time change points are double buffered so that one Timezone      *
+ * object can be used both by the main program and by an interrupt      *
+ * service routine without disabling interrupts: a new year's points    *
+ * are calculated into the inactive copy, which is then made active by  *
+ * a single byte write. An ISR that interrupts the update calculates    *
+ * its own points in the caller's scratch copy instead, and always      *
+ * reads a consistent set. This assumes a single core and that the ISR  *
+ * does not change years twice during one conversion by the main        *
+ * program. setRules() and readRules() must not be called while an ISR  *
+ * may use the object.                                                  *
+ *----------------------------------------------------------------------*/
+const Timezone::changes_t *Timezone::timeChanges(time_t t, changes_t *scratch)
+{
+    const changes_t *c = &m_changes[m_active];
+    if (t >= c->yrStart && t < c->yrEnd) return c;
+
+    if (m_busy)     // interrupted an update, leave both copies alone
+    {
+        calcTimeChanges(yearOf(t), scratch);
+        return scratch;
+    }
+
+    m_busy = 1;
+    uint8_t i = m_active ^ 1;
+    changes_t *n = &m_changes[i];
+    if (t < n->yrStart || t >= n->yrEnd) calcTimeChanges(yearOf(t), n);
+    TZ_BARRIER();
+    m_active = i;
+    m_busy = 0;
+    return n;
 }
 
 /*----------------------------------------------------------------------*
  * Calculate the DST and standard time change points for the given      *
- * given year as local and UTC time_t values.                           *
+ * given year as UTC time_t values.                                     *
  *----------------------------------------------------------------------*/
-void Timezone::calcTimeChanges(int yr)
+void Timezone::calcTimeChanges(int yr, changes_t *c)
 {
-    m_dstLoc = toTime_t(m_dst, yr);
-    m_stdLoc = toTime_t(m_std, yr);
-    m_dstUTC = m_dstLoc - m_std.offset * SECS_PER_MIN;
-    m_stdUTC = m_stdLoc - m_dst.offset * SECS_PER_MIN;
+    TZ_COUNT(calcs, 1);
+    c->yrStart = yearStart(yr);
+    c->yrEnd = yearStart(yr + 1);
+
+    // use the zone's table if it covers this year, filling it if needed.
+    // an ISR that finds an entry not yet ready calculates and stores the
+    // same values as the main program.
+    TimezoneTable *e = 0;
+    if (m_table != 0 && yr >= m_tableYear && yr - m_tableYear < m_tableYears)
+    {
+        e = &m_table[yr - m_tableYear];
+        if (e->ready)
+        {
+            TZ_BARRIER();
+            calcUTCChanges(c, e->dstLoc, e->stdLoc);
+            return;
+        }
+    }
+
+    time_t dstLoc, stdLoc;
+    calcLocalChanges(yr, &dstLoc, &stdLoc);
+    calcUTCChanges(c, dstLoc, stdLoc);
+    if (e != 0)
+    {
+        e->dstLoc = dstLoc;
+        e->stdLoc = stdLoc;
+        TZ_BARRIER();
+        e->ready = 1;
+    }
+}
+
+/*----------------------------------------------------------------------*
+ * Calculate the DST and standard time change points for the given      *
+ * year as local time_t values, from the family cache if possible.      *
+ *----------------------------------------------------------------------*/
+void Timezone::calcLocalChanges(int yr, time_t *dstLoc, time_t *stdLoc)
+{
+    // the family cache is shared by all objects; an ISR that interrupts
+    // its use by the main program calculates without it.
+    bool useFamily = !tzFamilyBusy;
+    uint8_t set = (uint8_t)(m_family + yr) % TZ_SETS;
+    if (useFamily)
+    {
+        tzFamilyBusy = 1;
+
+        // use the change points already calculated for this zone's family if possible
+        for (uint8_t i=0; i<TZ_WAYS; i++)
+        {
+            tzFamily_t &f = tzFamily[set][i];
+            if (f.yr == yr && isSchedule(f.dst, m_dst) && isSchedule(f.std, m_std))
+            {
+                *dstLoc = f.dstLoc;
+                *stdLoc = f.stdLoc;
+                tzFamilyNext[set] = i + 1 < TZ_WAYS ? i + 1 : 0;    // keep the slot just used
+                TZ_BARRIER();
+                tzFamilyBusy = 0;
+                TZ_COUNT(familyHits, 1);
+                return;
+            }
+        }
+    }
+    TZ_COUNT(familyMisses, 1);
+
+    *dstLoc = toTime_t(m_dst, yr);
+    if (sameSchedule(m_dst, m_std))     // no daylight time, one change point will do
+        *stdLoc = *dstLoc;
+    else
+        *stdLoc = toTime_t(m_std, yr);
+
+    if (useFamily)
+    {
+        uint8_t i = tzFamilyNext[set];
+        tzFamily_t &f = tzFamily[set][i];
+        tzFamilyNext[set] = i + 1 < TZ_WAYS ? i + 1 : 0;
+        setSchedule(f.dst, m_dst);
+        setSchedule(f.std, m_std);
+        f.yr = yr;
+        f.dstLoc = *dstLoc;
+        f.stdLoc = *stdLoc;
+        TZ_BARRIER();
+        tzFamilyBusy = 0;
+    }
+}
+
+/*----------------------------------------------------------------------*
+ * Calculate the DST and standard time change points as UTC time_t      *
+ * values from the local time change points.                            *
+ *----------------------------------------------------------------------*/
+void Timezone::calcUTCChanges(changes_t *c, time_t dstLoc, time_t stdLoc)
+{
+    c->dstUTC = dstLoc - m_stdOffset;
+    c->stdUTC = stdLoc - m_dstOffset;
+}
+
+/*----------------------------------------------------------------------*
+ * Calculate the offsets from UTC in seconds from the rules.            *
+ *----------------------------------------------------------------------*/
+void Timezone::calcOffsets()
+{
+    m_dstOffset = m_dst.offset * (long)SECS_PER_MIN;
+    m_stdOffset = m_std.offset * (long)SECS_PER_MIN;
 }
 
 /*----------------------------------------------------------------------*
@@ -165,10 +1047,104 @@ void Timezone::calcTimeChanges(int yr)
  *----------------------------------------------------------------------*/
 void Timezone::initTimeChanges()
 {
-    m_dstLoc = 0;
-    m_stdLoc = 0;
-    m_dstUTC = 0;
-    m_stdUTC = 0;
+    calcOffsets();
+    classify();
+    m_family = familyHash();
+    for (uint8_t i=0; i<2; i++)
+    {
+        changes_t &c = m_changes[i];
+        c.yrStart = 0;
+        c.yrEnd = 0;
+        c.dstUTC = 0;
+        c.stdUTC = 0;
+    }
+    m_active = 0;
+    m_busy = 0;
+#if TZ_ADAPTIVE
+    resetSpan();
+#endif
+    if (m_table != 0)
+    {
+        for (uint8_t i=0; i<m_tableYears; i++) m_table[i].ready = 0;
+    }
+}
+
+/*----------------------------------------------------------------------*
+ * Convert the given local time to UTC time. Unlike toUTC(), a local    *
+ * time that occurs twice is converted to its first occurrence and a    *
+ * local time that does not exist is converted to the time change that  *
+ * skips it.                                                            *
+ *----------------------------------------------------------------------*/
+time_t Timezone::localToUTC(time_t local)
+{
+    time_t dstUTC = local - m_dstOffset;
+    time_t stdUTC = local - m_stdOffset;
+    time_t early = dstUTC < stdUTC ? dstUTC : stdUTC;
+    time_t late = dstUTC < stdUTC ? stdUTC : dstUTC;
+
+    if (toLocal(early) == local) return early;
+    if (toLocal(late) == local) return late;
+    return nextTimeChange(early);
+}
+
+/*----------------------------------------------------------------------*
+ * Find the first occurrence of a daily local window (start and end in  *
+ * minutes after midnight) that ends after the given UTC time, and      *
+ * return its start and end as UTC times. Parts of the window that are  *
+ * skipped when changing to daylight time are not included, and a       *
+ * start or end in a repeated hour is taken at its first occurrence.    *
+ *----------------------------------------------------------------------*/
+void Timezone::nextWindow(time_t utc, uint16_t start, uint16_t end, time_t *winStart, time_t *winEnd)
+{
+    time_t day = previousMidnight(toLocal(utc)) - SECS_PER_DAY;
+    for (;;)
+    {
+        time_t s = localToUTC(day + start * SECS_PER_MIN);
+        time_t e = localToUTC(day + end * SECS_PER_MIN);
+        if (e > utc && e > s)
+        {
+            *winStart = s;
+            *winEnd = e;
+            return;
+        }
+        day += SECS_PER_DAY;
+    }
+}
+
+/*----------------------------------------------------------------------*
+ * Convert each of an array of n time change rules to a time_t value    *
+ * for the year in the same element of years, giving the same results  *
+ * as the rule calculation used by conversions but several times       *
+ * faster: the first of the month comes from the table of year starts  *
+ * and its day of the week by arithmetic, rather than from makeTime()   *
+ * and weekday(). The times are local times for the rules' zones.       *
+ * Years before 1970 need a signed time_t, so not on AVR.               *
+ *----------------------------------------------------------------------*/
+void Timezone::ruleTimes(const TimeChangeRule *rules, const int *years, time_t *times, size_t n)
+{
+    for (size_t i=0; i<n; i++)
+    {
+        const TimeChangeRule &r = rules[i];
+        int yr = years[i];
+        uint8_t m = r.month;
+        uint8_t w = r.week;
+        if (w == 0)             // "Last" rule, first week of the next month less 7 days
+        {
+            if (++m > 12)
+            {
+                m = 1;
+                ++yr;
+            }
+            w = 1;
+        }
+
+        long days = daysFromCivil(yr, m, 1);
+        long wd = (days + 4) % 7;       // 1 Jan 1970 was a Thursday
+        if (wd < 0) wd += 7;            // before 1970, round the weekday down too
+        days += (r.dow - 1 - wd + 7) % 7 + (w - 1) * 7;
+        if (r.week == 0) days -= 7;
+        times[i] = days * SECS_PER_DAY + r.hour * SECS_PER_HOUR;
+    }
 }
 
 /*----------------------------------------------------------------------*
@@ -206,14 +1182,310 @@ time_t Timezone::toTime_t(TimeChangeRule r, int yr)
     return t;
 }
 
+/*----------------------------------------------------------------------*
+ * Return the year (e.g. 2018) containing the given time_t, like        *
+ * year(t) from the Time library but without breaking the time into    *
+ * its fields: the year is estimated from the average length of a       *
+ * Gregorian year and corrected by at most one against the table of     *
+ * year starts.                                                         *
+ *----------------------------------------------------------------------*/
+int Timezone::yearOf(time_t t)
+{
+    unsigned long est = t / 31556952UL;     // seconds in an average year
+    if (est >= TZ_YEARS) return year(t);    // outside the table
+    uint8_t i = est;
+    if (t < (time_t)pgm_read_word(&tzYearDays[i]) * SECS_PER_DAY)
+        i--;
+    else if (i + 1 < TZ_YEARS && t >= (time_t)pgm_read_word(&tzYearDays[i + 1]) * SECS_PER_DAY)
+        i++;
+    return TZ_FIRST_YEAR + i;
+}
+
+/*----------------------------------------------------------------------*
+ * Return the time_t value for the start of the given year.             *
+ *----------------------------------------------------------------------*/
+time_t Timezone::yearStart(int yr)
+{
+    if (yr >= TZ_FIRST_YEAR && yr < TZ_FIRST_YEAR + TZ_YEARS)
+        return (time_t)pgm_read_word(&tzYearDays[yr - TZ_FIRST_YEAR]) * SECS_PER_DAY;
+
+    tmElements_t tm;
+    tm.Second = 0;
+    tm.Minute = 0;
+    tm.Hour = 0;
+    tm.Day = 1;
+    tm.Month = 1;
+    tm.Year = yr - 1970;
+    return makeTime(tm);
+}
+
+/*----------------------------------------------------------------------*
+ * Return the first local calendar boundary of the given unit after     *
+ * the given local time.                                                *
+ *----------------------------------------------------------------------*/
+time_t Timezone::nextTick(time_t local, uint8_t unit)
+{
+    switch (unit)
+    {
+        case Hourly:
+            return (local / SECS_PER_HOUR + 1) * SECS_PER_HOUR;
+        case Daily:
+            return nextMidnight(local);
+        case Weekly:    // 1 Jan 1970 was a Thursday, 4 days after the start of its week
+            return ((local / SECS_PER_DAY + 4) / DAYS_PER_WEEK + 1) * SECS_PER_WEEK - 4 * SECS_PER_DAY;
+        default:
+        {
+            tmElements_t tm;
+            breakTime(local, tm);
+            if (++tm.Month > 12)
+            {
+                tm.Month = 1;
+                ++tm.Year;
+            }
+            tm.Day = 1;
+            tm.Hour = 0;
+            tm.Minute = 0;
+            tm.Second = 0;
+            return makeTime(tm);
+        }
+    }
+}
+
+/*----------------------------------------------------------------------*
+ * Return the number of the hour, day, week (starting on Sunday) or     *
+ * month since 1970 that contains the given local time.                 *
+ *----------------------------------------------------------------------*/
+long Timezone::calendarIndex(time_t local, uint8_t unit)
+{
+    switch (unit)
+    {
+        case Hourly:
+            return local / SECS_PER_HOUR;
+        case Daily:
+            return local / SECS_PER_DAY;
+        case Weekly:    // 1 Jan 1970 was a Thursday, 4 days after the start of its week
+            return (local / SECS_PER_DAY + 4) / DAYS_PER_WEEK;
+        default:
+        {
+            int yr;
+            uint8_t mon, day;
+            civilFromDays(local / SECS_PER_DAY, &yr, &mon, &day);
+            return (yr - 1970) * 12L + mon - 1;
+        }
+    }
+}
+
+/*----------------------------------------------------------------------*
+ * Convert a number of days since 1970 to year, month and day, with     *
+ * no loops (H. Hinnant's civil_from_days algorithm).                   *
+ *----------------------------------------------------------------------*/
+void Timezone::civilFromDays(long days, int *yr, uint8_t *mon, uint8_t *day)
+{
+    days += 719468L;                                    // days since 1 Mar 0000
+    long era = days / 146097L;                          // 400-year eras
+    long doe = days - era * 146097L;                    // day of era, 0-146096
+    long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;   // year of era
+    long doy = doe - (365 * yoe + yoe / 4 - yoe / 100); // day of year from 1 Mar, 0-365
+    long mp = (5 * doy + 2) / 153;                      // month from March, 0-11
+    *day = doy - (153 * mp + 2) / 5 + 1;
+    *mon = mp < 10 ? mp + 3 : mp - 9;
+    *yr = yoe + era * 400 + (*mon <= 2);
+}
+
+/*----------------------------------------------------------------------*
+ * Convert a year, month and day to a number of days since 1970, from   *
+ * the table of year starts if possible, otherwise with no loops        *
+ * (H. Hinnant's days_from_civil algorithm).                            *
+ *----------------------------------------------------------------------*/
+long Timezone::daysFromCivil(int yr, uint8_t mon, uint8_t day)
+{
+    if (yr >= TZ_FIRST_YEAR && yr < TZ_FIRST_YEAR + TZ_YEARS)
+    {
+        bool leap = yr % 4 == 0 && (yr % 100 != 0 || yr % 400 == 0);
+        return pgm_read_word(&tzYearDays[yr - TZ_FIRST_YEAR])
+            + pgm_read_word(&tzMonthDays[mon - 1]) + (leap && mon > 2) + day - 1;
+    }
+
+    yr -= mon <= 2;
+    long era = (yr >= 0 ? yr : yr - 399) / 400;
+    long yoe = yr - era * 400;                                  // year of era, 0-399
+    long doy = (153 * (mon > 2 ? mon - 3 : mon + 9) + 2) / 5 + day - 1;   // day of year from 1 Mar
+    long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;           // day of era
+    return era * 146097L + doe - 719468L;
+}
+
+/*----------------------------------------------------------------------*
+ * Determine whether two time change rules occur at the same local      *
+ * time, i.e. differ at most in abbreviation and offset.                *
+ *----------------------------------------------------------------------*/
+bool Timezone::sameSchedule(const TimeChangeRule &r1, const TimeChangeRule &r2)
+{
+    return r1.week == r2.week && r1.dow == r2.dow
+        && r1.month == r2.month && r1.hour == r2.hour;
+}
+
+/*----------------------------------------------------------------------*
+ * Hash the schedule fields of the rules, i.e. the zone's family, to    *
+ * select its set in the family cache.                                  *
+ *----------------------------------------------------------------------*/
+uint8_t Timezone::familyHash()
+{
+    const TimeChangeRule *r[2] = {&m_dst, &m_std};
+    uint8_t h = 0;
+    for (uint8_t i=0; i<2; i++)
+    {
+        h = h * 31 + r[i]->week;
+        h = h * 31 + r[i]->dow;
+        h = h * 31 + r[i]->month;
+        h = h * 31 + r[i]->hour;
+    }
+    return h;
+}
+
+#if TZ_INSTRUMENT
+/*----------------------------------------------------------------------*
+ * Set a function to be called with the input of every conversion by   *
+ * any Timezone object, e.g. to record the workload with a              *
+ * TimezoneTrace. Pass NULL to stop.                                    *
+ *----------------------------------------------------------------------*/
+void Timezone::setCapture(tzCapture_t capture)
+{
+    s_capture = capture;
+}
+
+/*----------------------------------------------------------------------*
+ * Reset the counters returned by stats().                              *
+ *----------------------------------------------------------------------*/
+void Timezone::resetStats()
+{
+    m_stats.conversions = 0;
+    m_stats.calcs = 0;
+    m_stats.familyHits = 0;
+    m_stats.familyMisses = 0;
+    m_stats.engineSwitches = 0;
+}
+#endif
+
+#if TZ_VERIFY
+/*----------------------------------------------------------------------*
+ * Check one in every rate conversions against the plain rule           *
+ * calculation, or none if rate is zero, and reset the results          *
+ * returned by verifyStats().                                           *
+ *----------------------------------------------------------------------*/
+void Timezone::setVerify(uint16_t rate)
+{
+    m_verifyRate = rate;
+    m_verifyCount = 0;
+    m_verify.checked = 0;
+    m_verify.mismatches = 0;
+    m_verify.nLogged = 0;
+}
+
+/*----------------------------------------------------------------------*
+ * Check a DST determination for the given UTC or local time against    *
+ * the time change points calculated directly from the rules, without   *
+ * any of the caches, and record a mismatch.                            *
+ *----------------------------------------------------------------------*/
+void Timezone::verify(bool dst, time_t t, bool local)
+{
+    m_verifyCount = 0;
+    ++m_verify.checked;
+
+    int yr = yearOf(t);
+    changes_t ref;
+    ref.dstUTC = toTime_t(m_dst, yr) - m_std.offset * SECS_PER_MIN;
+    ref.stdUTC = toTime_t(m_std, yr) - m_dst.offset * SECS_PER_MIN;
+
+    if ((local ? locInDST(&ref, t) : utcInDST(&ref, t)) != dst)
+    {
+        ++m_verify.mismatches;
+        if (m_verify.nLogged < TZ_VERIFY_LOG) m_verify.logged[m_verify.nLogged++] = t;
+    }
+}
+#endif
+
 /*----------------------------------------------------------------------*
  * Read or update the daylight and standard time rules from RAM.        *
  *----------------------------------------------------------------------*/
 void Timezone::setRules(TimeChangeRule dstStart, TimeChangeRule stdStart)
 {
+    bool sameChanges = sameSchedule(dstStart, m_dst) && sameSchedule(stdStart, m_std);
     m_dst = dstStart;
     m_std = stdStart;
-    initTimeChanges();  // force calcTimeChanges() at next conversion call
+    if (sameChanges)        // only the offsets changed, local change points still valid
+    {
+        long dstShift = m_stdOffset;    // move the UTC change points by the change in offsets
+        long stdShift = m_dstOffset;
+        calcOffsets();
+        dstShift -= m_stdOffset;
+        stdShift -= m_dstOffset;
+        classify();
+        for (uint8_t i=0; i<2; i++)
+        {
+            m_changes[i].dstUTC += dstShift;
+            m_changes[i].stdUTC += stdShift;
+        }
+#if TZ_ADAPTIVE
+        resetSpan();
+#endif
+    }
+    else
+        initTimeChanges();  // force calcTimeChanges() at next conversion call
+}
+
+/*----------------------------------------------------------------------*
+ * Give the object a table in which to keep the time change points for  *
+ * nYears years from firstYear, so that each year is calculated only    *
+ * once however often the conversions move between years. The entries  *
+ * are calculated as they are first needed, and are recalculated after  *
+ * the rules change. Pass a null table to stop using it.                *
+ *----------------------------------------------------------------------*/
+void Timezone::setTable(TimezoneTable *table, int firstYear, uint8_t nYears)
+{
+    m_table = 0;
+    for (uint8_t i=0; table != 0 && i<nYears; i++) table[i].ready = 0;
+    m_tableYear = firstYear;
+    m_tableYears = nYears;
+    TZ_BARRIER();
+    m_table = table;
+}
+
+/*----------------------------------------------------------------------*
+ * Calculate all the entries of the table given to setTable() now,      *
+ * rather than as conversions need them, e.g. at startup so that later  *
+ * conversions take a predictable time. The rules are solved a few      *
+ * years at a time with ruleTimes().                                    *
+ *----------------------------------------------------------------------*/
+void Timezone::fillTable()
+{
+    const uint8_t CHUNK = 4;        // years per call to ruleTimes()
+    TimeChangeRule rules[2 * CHUNK];
+    int years[2 * CHUNK];
+    time_t times[2 * CHUNK];
+    TimezoneTable *table = m_table;
+    if (table == 0) return;
+
+    for (uint8_t first=0; first<m_tableYears; first+=CHUNK)
+    {
+        uint8_t n = m_tableYears - first < CHUNK ? m_tableYears - first : CHUNK;
+        for (uint8_t i=0; i<n; i++)
+        {
+            rules[2 * i] = m_dst;
+            rules[2 * i + 1] = m_std;
+            years[2 * i] = years[2 * i + 1] = m_tableYear + first + i;
+        }
+        ruleTimes(rules, years, times, 2 * n);
+        for (uint8_t i=0; i<n; i++)
+        {
+            TimezoneTable *e = &table[first + i];
+            if (e->ready) continue;
+            e->dstLoc = times[2 * i];
+            // no daylight time, one change point will do, as in calcLocalChanges()
+            e->stdLoc = sameSchedule(m_dst, m_std) ? times[2 * i] : times[2 * i + 1];
+            TZ_BARRIER();
+            e->ready = 1;
+        }
+    }
 }
 
 #ifdef __AVR__
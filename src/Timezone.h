@@ -15,10 +15,56 @@
 #endif
 #include <TimeLib.h>    // https://github.com/PaulStoffregen/Time
 
+// number of zone families (zones whose rules differ only in abbreviation
+// and offset) whose local time change points are shared between all
+// Timezone objects. each slot costs 18 bytes of RAM on AVR. the slots are
+// arranged in sets of TZ_FAMILY_WAYS, each family and year being looked
+// up only in the set selected by a hash of its rules, so a sketch with
+// many zones can have more slots without searching them all.
+#ifndef TZ_FAMILY_SLOTS
+#define TZ_FAMILY_SLOTS 2
+#endif
+#ifndef TZ_FAMILY_WAYS
+#define TZ_FAMILY_WAYS 2
+#endif
+
+// set to 1 to have each Timezone object count its conversions and time
+// change calculations, see stats(). costs 20 bytes of RAM per object,
+// and a pointer for the capture function shared by all objects.
+#ifndef TZ_INSTRUMENT
+#define TZ_INSTRUMENT 0
+#endif
+
+// set to 1 to have each Timezone object choose how it converts single
+// times from its recent inputs, see setEngine(). costs about 32 bytes of
+// RAM per object, so it is off unless the sketch's inputs need it.
+#ifndef TZ_ADAPTIVE
+#define TZ_ADAPTIVE 0
+#endif
+#ifndef TZ_ADAPT_WINDOW
+#define TZ_ADAPT_WINDOW 32      // conversions observed before each choice
+#endif
+
+// set TZ_VERIFY to 1 to have each Timezone object check a sample of its
+// DST determinations against the plain rule calculation, see setVerify()
+// and verifyStats(). one in TZ_VERIFY_RATE conversions is checked by
+// default, and the first TZ_VERIFY_LOG mismatching inputs are recorded.
+#ifndef TZ_VERIFY
+#define TZ_VERIFY 0
+#endif
+#ifndef TZ_VERIFY_RATE
+#define TZ_VERIFY_RATE 1024
+#endif
+#ifndef TZ_VERIFY_LOG
+#define TZ_VERIFY_LOG 4
+#endif
+
 // convenient constants for TimeChangeRules
 enum week_t {Last, First, Second, Third, Fourth}; 
 enum dow_t {Sun=1, Mon, Tue, Wed, Thu, Fri, Sat};
 enum month_t {Jan=1, Feb, Mar, Apr, May, Jun, Jul, Aug, Sep, Oct, Nov, Dec};
+enum tickUnit_t {Hourly, Daily, Weekly, Monthly};   // for localTicks() and localDifference()
+enum tzEngine_t {TzAuto, TzYearCache, TzCursor};    // for setEngine()
 
 // structure to describe rules for when daylight/summer time begins,
 // or when standard time begins.
@@ -32,6 +78,61 @@ struct TimeChangeRule
     int offset;        // offset from UTC in minutes
 };
         
+// counters kept by each Timezone object when TZ_INSTRUMENT is set
+struct TimezoneStats
+{
+    uint32_t conversions;   // times converted or tested for DST
+    uint32_t calcs;         // calls to calcTimeChanges(), i.e. year changes
+    uint32_t familyHits;    // time changes taken from the zone family cache
+    uint32_t familyMisses;  // time changes not in the zone family cache
+    uint32_t engineSwitches;    // changes of engine made by TzAuto
+};
+
+// results of the sampled checks made when TZ_VERIFY is set
+struct TimezoneVerify
+{
+    uint32_t checked;       // conversions checked
+    uint32_t mismatches;    // conversions that disagreed with the rule calculation
+    uint8_t nLogged;        // number of inputs in logged
+    time_t logged[TZ_VERIFY_LOG];   // first mismatching inputs, UTC or local
+};
+
+// time change points for one year, an element of the table given to
+// Timezone::setTable()
+struct TimezoneTable
+{
+    time_t dstLoc;              // dst start, local time
+    time_t stdLoc;              // std time start, local time
+    volatile uint8_t ready;     // the change points have been calculated
+};
+
+// arrays to receive the local calendar fields of times, one element per
+// time, for Timezone::breakLocal(). arrays not needed may be NULL.
+struct LocalFields
+{
+    int *year;          // e.g. 2018
+    uint8_t *month;     // 1-12
+    uint8_t *day;       // 1-31
+    uint8_t *hour;      // 0-23
+    uint8_t *minute;    // 0-59
+    uint8_t *second;    // 0-59
+    uint8_t *wday;      // day of week, 1=Sun, 2=Mon, ... 7=Sat
+};
+
+class Timezone;
+
+// conversions reported to the capture function, see Timezone::setCapture()
+enum tzOp_t {TzToLocal, TzToUTC, TzUtcIsDST, TzLocIsDST};
+typedef void (*tzCapture_t)(Timezone *tz, uint8_t op, time_t t);
+
+// a daily window of local time in a given time zone, for Timezone::overlap()
+struct LocalWindow
+{
+    Timezone *tz;
+    uint16_t start;     // local start time, minutes after midnight
+    uint16_t end;       // local end time, minutes after midnight, greater than start
+};
+
 class Timezone
 {
     public:
@@ -40,22 +141,149 @@ class Timezone
         Timezone(int address);
         time_t toLocal(time_t utc);
         time_t toLocal(time_t utc, TimeChangeRule **tcr);
+        void toLocal(const time_t *utc, time_t *local, size_t n);
+        bool toLocalBlock(time_t *base, time_t span);
+        void breakLocal(const time_t *utc, const LocalFields &fields, size_t n);
         time_t toUTC(time_t local);
+        void toUTC(const time_t *local, time_t *utc, size_t n);
+        time_t nextTimeChange(time_t utc);
+        time_t nextLocalTime(time_t utc, uint8_t hr, uint8_t mn);
+        uint16_t localTicks(time_t utcStart, time_t utcEnd, uint8_t unit, time_t *ticks, uint16_t max);
+        long localDifference(time_t utcA, time_t utcB, uint8_t unit);
+        void localDifference(const time_t *utcA, const time_t *utcB, long *diff, size_t n, uint8_t unit);
+        static uint16_t overlap(const LocalWindow *windows, uint8_t nWindows, time_t utcStart, time_t utcEnd,
+            time_t *starts, time_t *ends, uint16_t max);
+        static uint16_t differences(Timezone &tz1, Timezone &tz2, time_t utcStart, time_t utcEnd,
+            time_t *starts, time_t *ends, uint16_t max);
         bool utcIsDST(time_t utc);
+        void utcIsDST(const time_t *utc, bool *dst, size_t n);
+        void utcDSTMask(const time_t *utc, uint8_t *mask, size_t n);
         bool locIsDST(time_t local);
+        void locDSTMask(const time_t *local, uint8_t *mask, size_t n);
+        static size_t countBits(const uint8_t *mask, size_t n);
+        static int yearOf(time_t t);
+        static time_t yearStart(int yr);
         void setRules(TimeChangeRule dstStart, TimeChangeRule stdStart);
+        void setTable(TimezoneTable *table, int firstYear, uint8_t nYears);
+        void fillTable();
+        static void ruleTimes(const TimeChangeRule *rules, const int *years, time_t *times, size_t n);
         void readRules(int address);
         void writeRules(int address);
+#if TZ_ADAPTIVE
+        void setEngine(uint8_t engine);
+        uint8_t engine() { return m_using; }
+#endif
+#if TZ_INSTRUMENT
+        const TimezoneStats &stats() { return m_stats; }
+        void resetStats();
+        static void setCapture(tzCapture_t capture);
+#endif
+#if TZ_VERIFY
+        void setVerify(uint16_t rate);
+        const TimezoneVerify &verifyStats() { return m_verify; }
+#endif
 
     private:
-        void calcTimeChanges(int yr);
+        // time change points for one year, in UTC only: the local time
+        // change points are dstUTC + m_stdOffset and stdUTC + m_dstOffset
+        struct changes_t
+        {
+            time_t yrStart;     // start of the year the time changes are calculated for
+            time_t yrEnd;       // start of the following year, zero if not calculated
+            time_t dstUTC;      // dst start, given in UTC
+            time_t stdUTC;      // std time start, given in UTC
+        };
+
+        // the kinds of rules, each with its own way of testing for DST
+        enum shape_t {ShapeFixed, ShapeNorthern, ShapeSouthern, ShapeGeneric};
+
+        // a year's DST interval as a range test, see dstRange()
+        struct range_t
+        {
+            time_t yrStart;     // start of the year, as in changes_t
+            time_t yrEnd;       // start of the following year
+            time_t start;       // start of the range
+            time_t len;         // length of the range, zero for none
+            bool invert;        // DST is outside the range (southern hemisphere)
+        };
+
+        // a span of UTC times, within one year, with the same offset
+        struct span_t
+        {
+            time_t start;       // first UTC time in the span
+            time_t len;         // length of the span, zero if none
+            bool dst;           // the span is daylight time
+        };
+
+        const changes_t *timeChanges(time_t t, changes_t *scratch);
+        bool utcDST(time_t utc);
+#if TZ_ADAPTIVE
+        void moveSpan(const changes_t *c, time_t utc, bool dst);
+        void resetSpan();
+        void adapt(bool good);
+#endif
+        void calcTimeChanges(int yr, changes_t *c);
+        void calcLocalChanges(int yr, time_t *dstLoc, time_t *stdLoc);
+        void calcUTCChanges(changes_t *c, time_t dstLoc, time_t stdLoc);
+        void calcOffsets();
         void initTimeChanges();
+        time_t localToUTC(time_t local);
+        void nextWindow(time_t utc, uint16_t start, uint16_t end, time_t *winStart, time_t *winEnd);
+        range_t dstRange(const changes_t *c, bool local);
+        bool rangeDST(range_t &r, changes_t *scratch, time_t t, bool local, uint8_t op);
+        static bool inRange(const range_t &r, time_t t)
+        {
+            return ((unsigned long)(t - r.start) < (unsigned long)r.len) ^ r.invert;
+        }
+        void classify();
+        void dstMask(const time_t *t, uint8_t *mask, size_t n, bool local);
+        static time_t nextTick(time_t local, uint8_t unit);
+        static long calendarIndex(time_t local, uint8_t unit);
+        static void civilFromDays(long days, int *yr, uint8_t *mon, uint8_t *day);
+        static long daysFromCivil(int yr, uint8_t mon, uint8_t day);
         time_t toTime_t(TimeChangeRule r, int yr);
+        static bool sameSchedule(const TimeChangeRule &r1, const TimeChangeRule &r2);
+        uint8_t familyHash();
+#if TZ_VERIFY
+        bool verified(bool dst, time_t t, bool local)
+        {
+            if (m_verifyRate != 0 && ++m_verifyCount >= m_verifyRate) verify(dst, t, local);
+            return dst;
+        }
+        void verify(bool dst, time_t t, bool local);
+        static bool utcInDST(const changes_t *c, time_t utc);
+        bool locInDST(const changes_t *c, time_t local);
+#endif
         TimeChangeRule m_dst;   // rule for start of dst or summer time for any year
         TimeChangeRule m_std;   // rule for start of standard time for any year
-        time_t m_dstUTC;        // dst start for given/current year, given in UTC
-        time_t m_stdUTC;        // std time start for given/current year, given in UTC
-        time_t m_dstLoc;        // dst start for given/current year, given in local time
-        time_t m_stdLoc;        // std time start for given/current year, given in local time
+        changes_t m_changes[2]; // time changes for given/current year, double buffered
+        volatile uint8_t m_active;  // index of the m_changes in use
+        volatile uint8_t m_busy;    // the other m_changes is being updated
+        long m_dstOffset;       // offset from UTC in seconds for dst
+        long m_stdOffset;       // offset from UTC in seconds for std time
+        uint8_t m_family;       // hash of the rules' schedule, selects the family cache set
+        uint8_t m_shape;        // kind of rules, a shape_t
+        TimezoneTable *m_table; // change points for a range of years, filled as needed
+        int m_tableYear;        // first year in m_table
+        uint8_t m_tableYears;   // number of years in m_table
+#if TZ_ADAPTIVE
+        span_t m_span[2];       // span of the last time converted, double buffered
+        volatile uint8_t m_spanActive;  // index of the m_span in use
+        volatile uint8_t m_spanBusy;    // the other m_span is being updated
+        uint8_t m_engine;       // engine set by setEngine()
+        uint8_t m_using;        // engine in use
+        uint8_t m_window;       // conversions observed since the last choice
+        uint8_t m_score;        // of those, conversions that suited the cursor
+        time_t m_lastUTC;       // previous time converted
+#endif
+#if TZ_INSTRUMENT
+        TimezoneStats m_stats;
+        static tzCapture_t s_capture;   // called with each conversion's input
+#endif
+#if TZ_VERIFY
+        TimezoneVerify m_verify;
+        uint16_t m_verifyRate;      // check one in this many conversions, zero for none
+        uint16_t m_verifyCount;     // conversions since the last check
+#endif
 };
 #endif
@@ -0,0 +1,94 @@
+/*----------------------------------------------------------------------*
+ * Arduino Timezone Library                                             *
+ * Jack Christensen Mar 2012                                            *
+ *                                                                      *
+ * Arduino Timezone Library Copyright (C) 2018 by Jack Christensen and  *
+ * licensed under GNU GPL v3.0, https://www.gnu.org/licenses/gpl.html   *
+ *----------------------------------------------------------------------*/
+
+#include "TimezoneTrace.h"
+
+/*----------------------------------------------------------------------*
+ * Create an empty trace in the given buffer.                           *
+ *----------------------------------------------------------------------*/
+TimezoneTrace::TimezoneTrace(uint8_t *buf, size_t size)
+    : m_buf(buf), m_size(size)
+{
+    clear();
+}
+
+/*----------------------------------------------------------------------*
+ * Append a record. Returns false if the buffer is full.                *
+ *                                                                      *
+ * The difference d from the previous time is zigzag encoded (0, -1,    *
+ * 1, -2 ... become 0, 1, 2, 3 ...), then stored 7 bits per byte with   *
+ * the high bit set on all but the last byte. The first byte holds the  *
+ * operation in its low two bits and only five bits of the difference.  *
+ *----------------------------------------------------------------------*/
+bool TimezoneTrace::write(uint8_t op, time_t t)
+{
+    long d = (long)(t - m_lastWrite);
+    unsigned long z = d < 0 ? ((unsigned long)(-(d + 1)) << 1) | 1 : (unsigned long)d << 1;
+
+    uint8_t rec[1 + (sizeof(z) * 8 + 6) / 7];
+    uint8_t n = 0;
+    uint8_t b = (op & 3) | (z & 0x1F) << 2;
+    z >>= 5;
+    while (z != 0)
+    {
+        rec[n++] = b | 0x80;
+        b = z & 0x7F;
+        z >>= 7;
+    }
+    rec[n++] = b;
+
+    if (m_len + n > m_size) return false;
+    for (uint8_t i=0; i<n; i++) m_buf[m_len++] = rec[i];
+    m_lastWrite = t;
+    ++m_records;
+    return true;
+}
+
+/*----------------------------------------------------------------------*
+ * Read the next record. Returns false at the end of the trace.         *
+ *----------------------------------------------------------------------*/
+bool TimezoneTrace::read(uint8_t *op, time_t *t)
+{
+    if (m_pos >= m_len) return false;
+
+    uint8_t b = m_buf[m_pos++];
+    *op = b & 3;
+    unsigned long z = (b & 0x7F) >> 2;
+    uint8_t shift = 5;
+    while ((b & 0x80) && m_pos < m_len)
+    {
+        b = m_buf[m_pos++];
+        z |= (unsigned long)(b & 0x7F) << shift;
+        shift += 7;
+    }
+
+    long d = (z & 1) ? -(long)(z >> 1) - 1 : (long)(z >> 1);
+    m_lastRead += d;
+    *t = m_lastRead;
+    return true;
+}
+
+/*----------------------------------------------------------------------*
+ * Start reading again from the first record.                           *
+ *----------------------------------------------------------------------*/
+void TimezoneTrace::rewind()
+{
+    m_pos = 0;
+    m_lastRead = 0;
+}
+
+/*----------------------------------------------------------------------*
+ * Discard all records.                                                 *
+ *----------------------------------------------------------------------*/
+void TimezoneTrace::clear()
+{
+    m_len = 0;
+    m_records = 0;
+    m_lastWrite = 0;
+    rewind();
+}
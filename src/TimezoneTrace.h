@@ -0,0 +1,38 @@
+/*----------------------------------------------------------------------*
+ * Arduino Timezone Library                                             *
+ * Jack Christensen Mar 2012                                            *
+ *                                                                      *
+ * Arduino Timezone Library Copyright (C) 2018 by Jack Christensen and  *
+ * licensed under GNU GPL v3.0, https://www.gnu.org/licenses/gpl.html   *
+ *----------------------------------------------------------------------*/
+
+#ifndef TIMEZONE_TRACE_H_INCLUDED
+#define TIMEZONE_TRACE_H_INCLUDED
+#include "Timezone.h"
+
+// a compact binary record of conversion inputs (operation and time) in a
+// caller-supplied buffer, e.g. captured with Timezone::setCapture() and
+// replayed later to benchmark a realistic workload. each record holds
+// the difference from the previous time, so mostly sorted inputs take
+// one or two bytes each.
+class TimezoneTrace
+{
+    public:
+        TimezoneTrace(uint8_t *buf, size_t size);
+        bool write(uint8_t op, time_t t);
+        bool read(uint8_t *op, time_t *t);
+        void rewind();
+        void clear();
+        size_t length() { return m_len; }
+        uint32_t records() { return m_records; }
+
+    private:
+        uint8_t *m_buf;
+        size_t m_size;          // size of the buffer
+        size_t m_len;           // bytes written
+        size_t m_pos;           // read position
+        uint32_t m_records;     // records written
+        time_t m_lastWrite;     // time in the last record written
+        time_t m_lastRead;      // time in the last record read
+};
+#endif
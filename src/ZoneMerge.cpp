@@ -0,0 +1,162 @@
+/*----------------------------------------------------------------------*
+ * Arduino Timezone Library                                             *
+ * Jack Christensen Mar 2012                                            *
+ *                                                                      *
+ * Arduino Timezone Library Copyright (C) 2018 by Jack Christensen and  *
+ * licensed under GNU GPL v3.0, https://www.gnu.org/licenses/gpl.html   *
+ *----------------------------------------------------------------------*/
+
+#include "ZoneMerge.h"
+
+/*----------------------------------------------------------------------*
+ * Create a merge of nSources streams (at most TZ_MERGE_SOURCES).       *
+ * Source i gives local times in the time zone zones[i]; the source     *
+ * function is called with i to read each of them in turn.              *
+ *----------------------------------------------------------------------*/
+ZoneMerge::ZoneMerge(Timezone *const *zones, uint8_t nSources, mergeSource_t source)
+    : m_zones(zones), m_source(source), m_n(nSources), m_last(0xFF)
+{
+}
+
+/*----------------------------------------------------------------------*
+ * Read the first time from each source and start the merge. Returns    *
+ * false, and merges nothing, if there are more than TZ_MERGE_SOURCES   *
+ * sources.                                                             *
+ *----------------------------------------------------------------------*/
+bool ZoneMerge::begin()
+{
+    m_last = 0xFF;
+    if (m_n > TZ_MERGE_SOURCES)
+    {
+        m_n = 0;
+        return false;
+    }
+
+    for (uint8_t i=0; i<m_n; i++)
+    {
+        m_cursor[i].utc = 0;
+        m_cursor[i].end = 0;
+        m_cursor[i].offset = 0;
+        m_cursor[i].span = false;
+        m_cursor[i].more = true;
+        advance(i);
+    }
+    if (m_n > 0) m_tree[0] = build(1);
+    return true;
+}
+
+/*----------------------------------------------------------------------*
+ * Return the earliest UTC time of all the sources' current times, and  *
+ * the source it came from. Returns false when all sources are          *
+ * exhausted. The source is read for its next time on the following    *
+ * call, so the sketch can still use the record it read last for src.   *
+ * Equal times are returned in source order.                            *
+ *----------------------------------------------------------------------*/
+bool ZoneMerge::next(time_t *utc, uint8_t *src)
+{
+    if (m_n == 0) return false;
+
+    // advance the last winner and replay its path to the root
+    if (m_last != 0xFF)
+    {
+        advance(m_last);
+        uint8_t w = m_last;
+        for (uint8_t node = (w + m_n) / 2; node > 0; node /= 2)
+        {
+            if (before(m_tree[node], w))
+            {
+                uint8_t t = m_tree[node];
+                m_tree[node] = w;
+                w = t;
+            }
+        }
+        m_tree[0] = w;
+    }
+
+    uint8_t w = m_tree[0];
+    if (!m_cursor[w].more) return false;
+    *utc = m_cursor[w].utc;
+    *src = w;
+    m_last = w;
+    return true;
+}
+
+/*----------------------------------------------------------------------*
+ * Read the next local time from the given source and convert it to     *
+ * UTC. Times within the span of the previous time's offset are         *
+ * converted by subtraction; otherwise resolve() finds the UTC time     *
+ * and the span is moved.                                               *
+ *----------------------------------------------------------------------*/
+void ZoneMerge::advance(uint8_t src)
+{
+    cursor_t *c = &m_cursor[src];
+    time_t local;
+    if (!c->more || !m_source(src, &local))
+    {
+        c->more = false;
+        return;
+    }
+
+    time_t prev = c->utc;
+    time_t utc = local - c->offset;
+    if (!c->span || utc < prev || (c->end != 0 && utc >= c->end))
+    {
+        Timezone *tz = m_zones[src];
+        utc = resolve(tz, local, prev);
+        c->offset = tz->toLocal(utc) - utc;
+        c->end = tz->nextTimeChange(utc);   // zero if no time changes, one span forever
+        c->span = true;
+    }
+    c->utc = utc;
+}
+
+/*----------------------------------------------------------------------*
+ * Convert the given local time to UTC, choosing the second occurrence  *
+ * of a local time repeated when changing to standard time if the       *
+ * first occurrence is before prev, the source's previous UTC time.     *
+ * This keeps a source's times in UTC order through the repeated hour,  *
+ * as long as the source's local times are in the order they occurred.  *
+ *----------------------------------------------------------------------*/
+time_t ZoneMerge::resolve(Timezone *tz, time_t local, time_t prev)
+{
+    time_t utc = tz->toUTC(local);
+    if (utc >= prev) return utc;
+
+    time_t change = tz->nextTimeChange(utc);
+    if (change == 0) return utc;
+    time_t second = local - (tz->toLocal(change) - change);
+    if (second > utc && second >= change && tz->toLocal(second) == local) return second;
+    return utc;
+}
+
+/*----------------------------------------------------------------------*
+ * Build the loser tree below the given node, returning the winner.     *
+ * Nodes 1 to m_n - 1 are internal, m_n to 2 * m_n - 1 are the sources. *
+ *----------------------------------------------------------------------*/
+uint8_t ZoneMerge::build(uint8_t node)
+{
+    if (node >= m_n) return node - m_n;
+    uint8_t a = build(2 * node);
+    uint8_t b = build(2 * node + 1);
+    if (before(b, a))
+    {
+        uint8_t t = a;
+        a = b;
+        b = t;
+    }
+    m_tree[node] = b;
+    return a;
+}
+
+/*----------------------------------------------------------------------*
+ * Determine whether source a's current time comes before source b's.   *
+ * Exhausted sources come after all others.                             *
+ *----------------------------------------------------------------------*/
+bool ZoneMerge::before(uint8_t a, uint8_t b)
+{
+    const cursor_t *ca = &m_cursor[a];
+    const cursor_t *cb = &m_cursor[b];
+    if (ca->more != cb->more) return ca->more;
+    if (ca->utc != cb->utc) return ca->utc < cb->utc;
+    return a < b;
+}
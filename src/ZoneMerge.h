@@ -0,0 +1,54 @@
+/*----------------------------------------------------------------------*
+ * Arduino Timezone Library                                             *
+ * Jack Christensen Mar 2012                                            *
+ *                                                                      *
+ * Arduino Timezone Library Copyright (C) 2018 by Jack Christensen and  *
+ * licensed under GNU GPL v3.0, https://www.gnu.org/licenses/gpl.html   *
+ *----------------------------------------------------------------------*/
+
+#ifndef ZONE_MERGE_H_INCLUDED
+#define ZONE_MERGE_H_INCLUDED
+#include "Timezone.h"
+
+// maximum number of sources a ZoneMerge can merge. each source costs
+// about 14 bytes of RAM.
+#ifndef TZ_MERGE_SOURCES
+#define TZ_MERGE_SOURCES 8
+#endif
+
+// function called by ZoneMerge to read the next local time from a source.
+// returns false when the source has no more times.
+typedef bool (*mergeSource_t)(uint8_t src, time_t *local);
+
+// merges several streams of local times, each in time order in its own
+// time zone, into one stream in UTC order.
+class ZoneMerge
+{
+    public:
+        ZoneMerge(Timezone *const *zones, uint8_t nSources, mergeSource_t source);
+        bool begin();
+        bool next(time_t *utc, uint8_t *src);
+
+    private:
+        // a source's current time and the span of UTC with a constant offset
+        struct cursor_t
+        {
+            time_t utc;         // UTC of the source's current local time
+            time_t end;         // end of the offset span, zero if it never ends
+            long offset;        // offset from UTC in seconds in the span
+            bool span;          // offset and end are valid
+            bool more;          // the source has a current time
+        };
+
+        void advance(uint8_t src);
+        time_t resolve(Timezone *tz, time_t local, time_t prev);
+        uint8_t build(uint8_t node);
+        bool before(uint8_t a, uint8_t b);
+        Timezone *const *m_zones;
+        mergeSource_t m_source;
+        uint8_t m_n;                // number of sources
+        uint8_t m_last;             // source returned by next(), to be advanced
+        cursor_t m_cursor[TZ_MERGE_SOURCES];
+        uint8_t m_tree[TZ_MERGE_SOURCES];   // m_tree[0] is the winner, the rest losers
+};
+#endif